@@ -0,0 +1,43 @@
+#pragma once
+
+#include <ionl/macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace Ionl::Benchmarking {
+
+using BenchmarkFunc = void (*)();
+
+struct BenchmarkRegistration {
+    BenchmarkRegistration(const char* name, BenchmarkFunc func);
+};
+
+struct BenchmarkResult {
+    int iterations = 0;
+    double totalSeconds = 0.0;
+    // Amount of input processed by each iteration, for calculating throughput
+    int64_t bytesPerIteration = 0;
+
+    double CalcMegabytesPerSecond() const;
+    double CalcGigabytesPerSecond() const;
+};
+
+// Run `func` repeatedly until at least `minSeconds` has elapsed, and at least once
+BenchmarkResult RunBenchmark(int64_t bytesPerIteration, double minSeconds, const std::function<void()>& func);
+
+// Sink for benchmark results, so that the compiler can't optimize away the benchmarked work
+extern volatile size_t gSink;
+
+// `size` bytes of prose in paragraphs of about `paragraphLength` bytes, where roughly one word in `markupFrequency` is formatted
+std::string GenerateMarkdownDocument(size_t size, int paragraphLength, int markupFrequency);
+
+} // namespace Ionl::Benchmarking
+
+// Define a benchmark named "suite.name". IonlBenchmarks runs all benchmarks whose name starts with its first argument, or all of them without one.
+#define IONL_BENCHMARK(suite, name) \
+    static void CONCAT_4(Benchmark_, suite, _, name)(); \
+    static Ionl::Benchmarking::BenchmarkRegistration CONCAT_4(gBenchmark_, suite, _, name)(#suite "." #name, &CONCAT_4(Benchmark_, suite, _, name)); \
+    static void CONCAT_4(Benchmark_, suite, _, name)()
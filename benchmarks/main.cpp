@@ -0,0 +1,100 @@
+#include "benchmarking.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace {
+struct BenchmarkCase {
+    const char* name;
+    Ionl::Benchmarking::BenchmarkFunc func;
+};
+
+// Function local, so that it exists before the BenchmarkRegistration's in other translation units get constructed
+std::vector<BenchmarkCase>& GetBenchmarkCases() {
+    static std::vector<BenchmarkCase> benchmarkCases;
+    return benchmarkCases;
+}
+} // namespace
+
+volatile size_t Ionl::Benchmarking::gSink = 0;
+
+Ionl::Benchmarking::BenchmarkRegistration::BenchmarkRegistration(const char* name, BenchmarkFunc func) {
+    GetBenchmarkCases().push_back(BenchmarkCase{ .name = name, .func = func });
+}
+
+double Ionl::Benchmarking::BenchmarkResult::CalcMegabytesPerSecond() const {
+    return totalSeconds > 0.0 ? (double)bytesPerIteration * iterations / totalSeconds / 1e6 : 0.0;
+}
+
+double Ionl::Benchmarking::BenchmarkResult::CalcGigabytesPerSecond() const {
+    return CalcMegabytesPerSecond() / 1e3;
+}
+
+Ionl::Benchmarking::BenchmarkResult Ionl::Benchmarking::RunBenchmark(int64_t bytesPerIteration, double minSeconds, const std::function<void()>& func) {
+    using Clock = std::chrono::steady_clock;
+
+    // Warm up caches and the allocator
+    func();
+
+    BenchmarkResult result{ .bytesPerIteration = bytesPerIteration };
+    auto begin = Clock::now();
+    do {
+        func();
+        result.iterations += 1;
+        result.totalSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    } while (result.totalSeconds < minSeconds);
+    return result;
+}
+
+std::string Ionl::Benchmarking::GenerateMarkdownDocument(size_t size, int paragraphLength, int markupFrequency) {
+    constexpr std::string_view kWords[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "fusce", "nulla", "nibh", "dictum", "id", "enim", "at", "laoreet",
+    };
+    constexpr std::string_view kMarkups[] = { "**", "_", "__", "~~", "`" };
+
+    std::mt19937 rng(0);
+    std::string res;
+    res.reserve(size + 64);
+    int currParagraphLength = 0;
+    while (res.size() < size) {
+        auto word = kWords[rng() % std::size(kWords)];
+        if (markupFrequency > 0 && rng() % markupFrequency == 0) {
+            auto markup = kMarkups[rng() % std::size(kMarkups)];
+            res += markup;
+            res += word;
+            res += markup;
+        } else {
+            res += word;
+        }
+        currParagraphLength += (int)word.size();
+
+        if (currParagraphLength >= paragraphLength) {
+            res += '\n';
+            currParagraphLength = 0;
+        } else {
+            res += ' ';
+        }
+    }
+    return res;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    int numRun = 0;
+    for (auto& benchmarkCase : GetBenchmarkCases()) {
+        if (std::strncmp(benchmarkCase.name, filter, std::strlen(filter)) != 0) {
+            continue;
+        }
+
+        numRun += 1;
+        std::printf("[ RUN  ] %s\n", benchmarkCase.name);
+        benchmarkCase.func();
+    }
+
+    return numRun > 0 ? 0 : 1;
+}
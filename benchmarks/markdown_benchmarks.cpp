@@ -0,0 +1,61 @@
+#include "benchmarking.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Ionl;
+using namespace Ionl::Benchmarking;
+
+namespace {
+struct ParseBenchmarkCase {
+    const char* name;
+    int paragraphLength;
+    int markupFrequency;
+    // Put the whole document inside a fenced code block, like pasted code or logs
+    bool isFencedCode = false;
+};
+
+constexpr ParseBenchmarkCase kParseBenchmarkCases[] = {
+    { "Plain prose", 600, 0 },
+    { "Prose with occasional markup", 600, 20 },
+    { "Short lines", 40, 20 },
+    { "Markup heavy", 200, 1 },
+    { "Fenced code", 60, 1, true },
+};
+} // namespace
+
+// MdParser::Parse() over 1 MiB documents, walking every char with the state machine vs skipping plain text with the control char scan
+IONL_BENCHMARK(markdown, parse_throughput) {
+    std::printf("%-32s %16s %16s %8s\n", "Document", "Per char (MB/s)", "Scanning (MB/s)", "Speedup");
+    for (auto& benchmarkCase : kParseBenchmarkCases) {
+        auto content = GenerateMarkdownDocument(1024 * 1024, benchmarkCase.paragraphLength, benchmarkCase.markupFrequency);
+        if (benchmarkCase.isFencedCode) {
+            content = "```\n" + content + "\n```";
+        }
+        GapBuffer buffer(content);
+
+        // Reuse the parser like TextBuffer does, so that allocations don't show up in the numbers
+        MdParser parser;
+        std::vector<TextRun> textRuns;
+
+        auto bytes = (int64_t)content.size();
+        auto perChar = RunBenchmark(bytes, 0.5, [&]() {
+            textRuns.clear();
+            parser.Parse({ .src = &buffer, .debugDisableControlCharScan = true }, textRuns);
+            gSink = textRuns.size();
+        });
+        auto scanning = RunBenchmark(bytes, 0.5, [&]() {
+            textRuns.clear();
+            parser.Parse({ .src = &buffer }, textRuns);
+            gSink = textRuns.size();
+        });
+
+        double before = perChar.CalcMegabytesPerSecond();
+        double after = scanning.CalcMegabytesPerSecond();
+        std::printf("%-32s %16.1f %16.1f %7.2fx\n", benchmarkCase.name, before, after, after / before);
+    }
+}
@@ -0,0 +1,89 @@
+#include "benchmarking.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <imgui/imgui_internal.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+using namespace Ionl;
+using namespace Ionl::Benchmarking;
+
+namespace {
+// `size` bytes of CJK text, with some ASCII punctuation and line breaks mixed in like in real documents
+std::string GenerateCjkDocument(size_t size) {
+    std::mt19937 rng(0);
+    std::string res;
+    res.reserve(size + 8);
+    while (res.size() < size) {
+        auto roll = rng() % 64;
+        if (roll == 0) {
+            res += '\n';
+        } else if (roll < 4) {
+            res += ", "sv;
+        } else {
+            char utf8[5];
+            // CJK Unified Ideographs
+            int count = ImTextCharToUtf8Counted(utf8, 0x4E00 + rng() % (0x9FFF - 0x4E00));
+            res.append(utf8, count);
+        }
+    }
+    return res;
+}
+
+struct TranscodeBenchmarkCase {
+    const char* name;
+    std::string (*generate)();
+};
+
+const TranscodeBenchmarkCase kTranscodeBenchmarkCases[] = {
+    { "ASCII-heavy", []() { return GenerateMarkdownDocument(1024 * 1024, 600, 20); } },
+    { "CJK-heavy", []() { return GenerateCjkDocument(1024 * 1024); } },
+};
+} // namespace
+
+// GapBuffer::UpdateContent() and GapBuffer::ExtractContent() over 1 MiB documents, against doing the same with the ImText* functions
+IONL_BENCHMARK(utf8, transcode_throughput) {
+    std::printf("%-16s %16s %16s %16s %16s\n", "GB/s of UTF-8", "Load (ImText*)", "Load", "Save (ImText*)", "Save");
+    for (auto& benchmarkCase : kTranscodeBenchmarkCases) {
+        auto content = benchmarkCase.generate();
+        auto bytes = (int64_t)content.size();
+        auto contentBegin = content.data();
+        auto contentEnd = content.data() + content.size();
+
+        std::vector<ImWchar> chars(content.size());
+        auto loadImGui = RunBenchmark(bytes, 0.5, [&]() {
+            int numChars = ImTextCountCharsFromUtf8(contentBegin, contentEnd);
+            ImTextStrFromUtf8NoNullTerminate(chars.data(), numChars, contentBegin, contentEnd);
+            gSink = numChars;
+        });
+
+        GapBuffer buffer(content);
+        auto load = RunBenchmark(bytes, 0.5, [&]() {
+            buffer.UpdateContent(content);
+            gSink = buffer.GetContentSize();
+        });
+
+        auto charsBegin = buffer.buffer;
+        auto charsEnd = buffer.buffer + buffer.GetContentSize();
+        auto saveImGui = RunBenchmark(bytes, 0.5, [&]() {
+            std::string result(ImTextCountUtf8BytesFromStr(charsBegin, charsEnd), '\0');
+            ImTextStrToUtf8(result.data(), (int)result.size() + 1, charsBegin, charsEnd);
+            gSink = result.size();
+        });
+        auto save = RunBenchmark(bytes, 0.5, [&]() {
+            gSink = buffer.ExtractContent().size();
+        });
+
+        std::printf(
+            "%-16s %16.2f %16.2f %16.2f %16.2f\n",
+            benchmarkCase.name,
+            loadImGui.CalcGigabytesPerSecond(),
+            load.CalcGigabytesPerSecond(),
+            saveImGui.CalcGigabytesPerSecond(),
+            save.CalcGigabytesPerSecond());
+    }
+}
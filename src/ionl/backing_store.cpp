@@ -31,6 +31,7 @@ public:
     SQLiteStatement setBulletContent;
     SQLiteStatement setBulletPositionAtBeginning;
     SQLiteStatement setBulletPositionAfter;
+    SQLiteStatement findTextualBullets;
 
 public:
     void SetDatabaseUserVersion() {
@@ -226,6 +227,14 @@ FROM (
     WHERE Pbid = ?3
 ) AS _Anchor
 WHERE Pbid = ?1
+)"""sv);
+
+    // NOTE: instr() finds the empty string in every value
+    m->findTextualBullets.Initialize(m->database, R"""(
+SELECT Pbid, ContentValue
+FROM Bullets
+WHERE ContentType = ?1
+  AND instr(ContentValue, ?2) > 0
 )"""sv);
 }
 
@@ -251,6 +260,21 @@ void SQLiteBackingStore::RollbackTransaction() {
     sqlite3_reset(m->rollbackTransaction);
 }
 
+void SQLiteBackingStore::ForEachTextualBullet(std::string_view text, const std::function<void(Pbid, std::string_view)>& func) {
+    SQLiteRunningStatement rt(m->findTextualBullets);
+    // An empty std::string_view may point to nullptr, which would bind NULL and match nothing
+    rt.BindArguments((int)BulletType::Textual, text.empty() ? ""sv : text);
+    while (true) {
+        int err = rt.Step();
+        if (err != SQLITE_ROW) {
+            break;
+        }
+
+        auto [pbid, content] = rt.ResultColumns<int64_t, std::string_view>();
+        func((Pbid)pbid, content);
+    }
+}
+
 Bullet SQLiteBackingStore::FetchBullet(Pbid pbid) {
     Bullet result;
     result.pbid = pbid;
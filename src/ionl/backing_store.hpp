@@ -2,7 +2,9 @@
 
 #include <ionl/document.hpp>
 
+#include <functional>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 namespace Ionl {
@@ -34,6 +36,10 @@ public:
     void CommitTransaction();
     void RollbackTransaction();
 
+    // Call `func` on every textual bullet whose content contains `text` byte for byte, or on all of them if `text` is empty.
+    // Rows are streamed one at a time; the content passed to `func` is only valid during the call.
+    void ForEachTextualBullet(std::string_view text, const std::function<void(Pbid, std::string_view)>& func);
+
     Bullet FetchBullet(Pbid pbid) override;
     Pbid FetchParentOfBullet(Pbid bullet) override;
     std::vector<Pbid> FetchChildrenOfBullet(Pbid bullet) override;
@@ -0,0 +1,117 @@
+#include "batch_parser.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Split jobs into about this many chunks per worker thread, trading off per-task overhead and load balancing
+constexpr int kChunksPerThread = 4;
+} // namespace
+
+Ionl::TextBufferBatchParser::TextBufferBatchParser(WorkerPool& pool)
+    : mPool{ &pool } {}
+
+void Ionl::TextBufferBatchParser::Submit(std::span<TextBuffer* const> textBuffers) {
+    if (textBuffers.empty()) {
+        return;
+    }
+
+    auto batch = std::make_shared<Batch>();
+    batch->jobs.reserve(textBuffers.size());
+    int64_t totalSize = 0;
+    for (auto tb : textBuffers) {
+        // Compacted TextBuffer's are parsed when they get expanded
+        if (tb->isCompacted) {
+            continue;
+        }
+        batch->jobs.push_back(Job{
+            .target = tb,
+            .content = tb->TakeSnapshot(),
+            .cacheDataVersion = tb->cacheDataVersion,
+            .textRuns = {},
+        });
+        totalSize += tb->gapBuffer.GetContentSize();
+    }
+    if (batch->jobs.empty()) {
+        return;
+    }
+
+    // Cut the jobs into chunks of roughly equal amount of text
+    std::vector<std::pair<size_t, size_t>> chunks;
+    int64_t chunkSizeTarget = std::max<int64_t>(totalSize / (mPool->GetThreadCount() * kChunksPerThread), 1);
+    int64_t currChunkSize = 0;
+    size_t currChunkBegin = 0;
+    for (size_t i = 0; i < batch->jobs.size(); ++i) {
+        currChunkSize += batch->jobs[i].content->GetContentSize();
+        if (currChunkSize >= chunkSizeTarget || i + 1 == batch->jobs.size()) {
+            chunks.push_back({ currChunkBegin, i + 1 });
+            currChunkBegin = i + 1;
+            currChunkSize = 0;
+        }
+    }
+
+    batch->numPendingChunks.store((int)chunks.size(), std::memory_order_relaxed);
+    for (auto [begin, end] : chunks) {
+        mPool->Submit([batch, begin, end]() {
+            MdParser parser;
+            for (size_t i = begin; i < end; ++i) {
+                auto& job = batch->jobs[i];
+                parser.Parse({ .src = &job.content.Get() }, job.textRuns);
+            }
+
+            batch->numPendingChunks.fetch_sub(1, std::memory_order_release);
+            batch->numPendingChunks.notify_all();
+        });
+    }
+
+    mBatches.push_back(std::move(batch));
+}
+
+void Ionl::TextBufferBatchParser::Submit(TextBuffer& textBuffer) {
+    TextBuffer* textBuffers[] = { &textBuffer };
+    Submit(textBuffers);
+}
+
+void Ionl::TextBufferBatchParser::Cancel(TextBuffer& textBuffer) {
+    // Only the UI thread touches `Job::target`, so this is safe even if the batch is still being parsed
+    for (auto& batch : mBatches) {
+        for (auto& job : batch->jobs) {
+            if (job.target == &textBuffer) {
+                job.target = nullptr;
+            }
+        }
+    }
+}
+
+int Ionl::TextBufferBatchParser::InstallResults(bool wait) {
+    int numInstalled = 0;
+    std::erase_if(mBatches, [&](const std::shared_ptr<Batch>& batch) {
+        int numPending;
+        while ((numPending = batch->numPendingChunks.load(std::memory_order_acquire)) != 0) {
+            if (!wait) {
+                return false;
+            }
+            batch->numPendingChunks.wait(numPending, std::memory_order_acquire);
+        }
+
+        for (auto& job : batch->jobs) {
+            auto tb = job.target;
+            if (tb == nullptr) {
+                continue;
+            }
+
+            // The TextRun's are buffer indices, so they are only valid if neither the content nor the gap location changed
+            bool isUnchanged = tb->cacheDataVersion == job.cacheDataVersion &&
+                !tb->hasDirtyRange &&
+                tb->gapBuffer.bufferSize == job.content->bufferSize &&
+                tb->gapBuffer.frontSize == job.content->frontSize &&
+                tb->gapBuffer.gapSize == job.content->gapSize;
+            if (isUnchanged) {
+                tb->InstallTextRuns(job.textRuns);
+                numInstalled += 1;
+            }
+        }
+        return true;
+    });
+    return numInstalled;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/worker_pool.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Ionl {
+
+// Parses many TextBuffer's concurrently on a WorkerPool, e.g. all bullets loaded when a subtree is expanded.
+// Results are held back until InstallResults() is called on the UI thread, so that TextBuffer's never change in the middle of a frame.
+class TextBufferBatchParser {
+private:
+    struct Job {
+        // Set to nullptr by Cancel()
+        TextBuffer* target;
+        // Workers parse a snapshot of the content, so that the UI thread is free to edit the TextBuffer in the mean time
+        GapBufferSnapshot content;
+        int cacheDataVersion;
+        std::vector<TextRun> textRuns;
+    };
+
+    struct Batch {
+        std::vector<Job> jobs;
+        std::atomic<int> numPendingChunks;
+    };
+
+    WorkerPool* mPool;
+    // Shared with the worker tasks, which may outlive this object if it is destroyed with batches in-flight
+    std::vector<std::shared_ptr<Batch>> mBatches;
+
+public:
+    explicit TextBufferBatchParser(WorkerPool& pool);
+
+    TextBufferBatchParser(const TextBufferBatchParser&) = delete;
+    TextBufferBatchParser& operator=(const TextBufferBatchParser&) = delete;
+
+    // Queue a full parse of each of `textBuffers`.
+    // The TextBuffer's must stay alive until their results are installed, or Cancel() is called on them.
+    void Submit(std::span<TextBuffer* const> textBuffers);
+    void Submit(TextBuffer& textBuffer);
+    // Drop the pending result for `textBuffer`, if any.
+    void Cancel(TextBuffer& textBuffer);
+
+    // Install finished results, skipping TextBuffer's edited since submission; call at a frame boundary. Returns the number installed.
+    int InstallResults(bool wait = false);
+
+    bool HasPendingResults() const { return !mBatches.empty(); }
+};
+
+} // namespace Ionl
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <imgui/imgui.h>
+#include <ionl/gap_buffer.hpp>
+#include <ionl/simd.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace Ionl {
+
+// Find the first char in [begin, end) that is one of `kChars`, or `end` if there is none.
+template <ImWchar... kChars>
+const ImWchar* FindAnyOf(const ImWchar* begin, const ImWchar* end) {
+    if constexpr (kCanVectorizeImWchar) {
+#if IONL_SIMD_AVX2
+        for (; end - begin >= 16; begin += 16) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            __m256i matches = _mm256_setzero_si256();
+            ((matches = _mm256_or_si256(matches, _mm256_cmpeq_epi16(chunk, _mm256_set1_epi16(kChars)))), ...);
+            auto mask = (uint32_t)_mm256_movemask_epi8(matches);
+            if (mask != 0) {
+                return begin + FirstLane16(mask);
+            }
+        }
+#endif
+#if IONL_SIMD_SSE2
+        for (; end - begin >= 8; begin += 8) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            __m128i matches = _mm_setzero_si128();
+            ((matches = _mm_or_si128(matches, _mm_cmpeq_epi16(chunk, _mm_set1_epi16(kChars)))), ...);
+            auto mask = (uint32_t)_mm_movemask_epi8(matches);
+            if (mask != 0) {
+                return begin + FirstLane16(mask);
+            }
+        }
+#endif
+    }
+
+    return std::find_if(begin, end, [](ImWchar c) { return ((c == kChars) || ...); });
+}
+
+// Count the occurrences of `kChar` in [begin, end).
+template <ImWchar kChar>
+int64_t CountOf(const ImWchar* begin, const ImWchar* end) {
+    int64_t result = 0;
+    if constexpr (kCanVectorizeImWchar) {
+#if IONL_SIMD_AVX2
+        for (; end - begin >= 16; begin += 16) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+            auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(chunk, _mm256_set1_epi16(kChar)));
+            result += CountLanes16(mask);
+        }
+#endif
+#if IONL_SIMD_SSE2
+        for (; end - begin >= 8; begin += 8) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            auto mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(chunk, _mm_set1_epi16(kChar)));
+            result += CountLanes16(mask);
+        }
+#endif
+    }
+
+    return result + std::count(begin, end, kChar);
+}
+
+// Find the logical index of the first char that is one of `kChars` in the logical range [begin, end) of `buf`, or `end` if there is none.
+template <ImWchar... kChars>
+int64_t FindNextOf(const GapBuffer& buf, int64_t begin, int64_t end) {
+    for (auto segment : buf.Segments(begin, end)) {
+        auto found = FindAnyOf<kChars...>(segment.data(), segment.data() + segment.size());
+        if (found != segment.data() + segment.size()) {
+            return begin + (found - segment.data());
+        }
+        begin += (int64_t)segment.size();
+    }
+    return end;
+}
+
+// Find the logical index of the last char that is one of `kChars` in the logical range [begin, end) of `buf`, or -1 if there is none.
+template <ImWchar... kChars>
+int64_t FindPrevOf(const GapBuffer& buf, int64_t begin, int64_t end) {
+    auto segments = buf.Segments(begin, end);
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+        auto& segment = *it;
+        end -= (int64_t)segment.size();
+        auto found = std::find_if(segment.rbegin(), segment.rend(), [](ImWchar c) { return ((c == kChars) || ...); });
+        if (found != segment.rend()) {
+            return end + (segment.rend() - found - 1);
+        }
+    }
+    return -1;
+}
+
+} // namespace Ionl
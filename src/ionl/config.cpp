@@ -1,7 +1,12 @@
 #include "config.hpp"
 
+#include <ionl/edit_history.hpp>
+#include <ionl/gap_buffer.hpp>
+
 #include <toml++/toml.h>
 
+#include <chrono>
+
 using namespace std::literals;
 namespace fs = std::filesystem;
 
@@ -32,6 +37,11 @@ void Ionl::LoadConfigFromFile(Config& cfg, const fs::path& file) {
     cfg.monospaceBoldFont = o["Style"]["MonospaceBoldFont"].value_or(""sv);
     cfg.monospaceBoldItalicFont = o["Style"]["MonospaceBoldItalicFont"].value_or(""sv);
     cfg.headingFont = o["Style"]["HeadingFont"].value_or(""sv);
+    cfg.gapBufferDoublingLimit = o["Editor"]["GapBufferDoublingLimit"].value_or(GapBufferGrowthPolicy{}.doublingLimit);
+    cfg.gapBufferLinearGrowthStep = o["Editor"]["GapBufferLinearGrowthStep"].value_or(GapBufferGrowthPolicy{}.linearGrowthStep);
+    cfg.undoMemoryLimit = o["Editor"]["UndoMemoryLimit"].value_or(EditHistoryPolicy{}.memoryLimit);
+    cfg.undoCoalesceIntervalMs = o["Editor"]["UndoCoalesceIntervalMs"].value_or(
+        (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(EditHistoryPolicy{}.coalesceInterval).count());
 }
 
 Ionl::Config Ionl::gConfig{};
@@ -2,6 +2,7 @@
 
 #include <ionl/markdown.hpp>
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
@@ -19,6 +20,12 @@ struct Config {
     std::string monospaceBoldFont;
     std::string monospaceBoldItalicFont;
     std::string headingFont;
+    // See GapBufferGrowthPolicy
+    int64_t gapBufferDoublingLimit;
+    int64_t gapBufferLinearGrowthStep;
+    // See EditHistoryPolicy
+    int64_t undoMemoryLimit;
+    int64_t undoCoalesceIntervalMs;
 };
 
 void LoadConfigFromFile(Config& cfg, const std::filesystem::path& file);
@@ -4,6 +4,7 @@
 #include <ionl/macros.hpp>
 #include <ionl/utils.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <string_view>
 
@@ -20,8 +21,9 @@ bool Ionl::Bullet::IsRootBullet() const {
     return pbid == kRootBulletPbid;
 }
 
-Ionl::Document::Document(IBackingStore& store)
-    : mStore{ &store } //
+Ionl::Document::Document(IBackingStore& store, TextBufferBatchParser& batchParser)
+    : mStore{ &store }
+    , mBatchParser{ &batchParser } //
 {
     // Always load the root bullet
     auto& root = FetchBulletByPbid(kRootBulletPbid);
@@ -75,6 +77,15 @@ Ionl::Bullet& Ionl::Document::CreateBullet() {
 }
 
 void Ionl::Document::DeleteBullet(Bullet& bullet) {
+    if (auto bc = std::get_if<BulletContentTextual>(&bullet.content.v); bc && bc->textBuffer) {
+        mBatchParser->Cancel(*bc->textBuffer);
+        std::erase(mUnparsedTextBuffers, bc->textBuffer.get());
+        std::erase(mExpandedTexts, bc);
+        if (bc->isTextStale) {
+            std::erase(mStaleTextBullets, bullet.rbid);
+        }
+    }
+
     mStore->DeleteBullet(bullet.pbid);
     mPtoRmap.erase(bullet.pbid);
     mFreeRbids.push_back(bullet.rbid);
@@ -83,9 +94,75 @@ void Ionl::Document::DeleteBullet(Bullet& bullet) {
 }
 
 void Ionl::Document::UpdateBulletContent(Bullet& bullet) {
+    // A background parse of the previous content would be discarded when installed anyways, don't keep it around until then
+    if (auto bc = std::get_if<BulletContentTextual>(&bullet.content.v); bc && bc->textBuffer) {
+        mBatchParser->Cancel(*bc->textBuffer);
+    }
+
     mStore->SetBulletContent(bullet.pbid, bullet.content);
 }
 
+Ionl::TextBuffer& Ionl::Document::FetchTextBuffer(BulletContentTextual& bc) {
+    if (!bc.textBuffer) {
+        bc.textBuffer = std::make_unique<TextBuffer>(GapBuffer(bc.text), false);
+        mUnparsedTextBuffers.push_back(bc.textBuffer.get());
+        mExpandedTexts.push_back(&bc);
+    } else if (bc.textBuffer->isCompacted) {
+        bc.textBuffer->Expand();
+        mExpandedTexts.push_back(&bc);
+    }
+    bc.lastFetchTime = std::chrono::steady_clock::now();
+    return *bc.textBuffer;
+}
+
+void Ionl::Document::MarkTextEdited(Bullet& bullet) {
+    auto& bc = std::get<BulletContentTextual>(bullet.content.v);
+    // A background parse of the previous content would be discarded when installed anyways, don't keep it around until then
+    mBatchParser->Cancel(*bc.textBuffer);
+
+    if (!bc.isTextStale) {
+        bc.isTextStale = true;
+        mStaleTextBullets.push_back(bullet.rbid);
+    }
+}
+
+void Ionl::Document::SaveStaleTexts() {
+    for (Rbid rbid : mStaleTextBullets) {
+        SaveStaleText(*GetBulletByRbid(rbid));
+    }
+    mStaleTextBullets.clear();
+}
+
+void Ionl::Document::Update() {
+    mBatchParser->Submit(mUnparsedTextBuffers);
+    mUnparsedTextBuffers.clear();
+
+    auto now = std::chrono::steady_clock::now();
+    std::erase_if(mStaleTextBullets, [&](Rbid rbid) {
+        auto& bullet = *GetBulletByRbid(rbid);
+        if (now - std::get<BulletContentTextual>(bullet.content.v).textBuffer->lastEditTime < kTextSaveIdleTime) {
+            return false;
+        }
+        SaveStaleText(bullet);
+        return true;
+    });
+
+    std::erase_if(mExpandedTexts, [&](BulletContentTextual* bc) {
+        auto& tb = *bc->textBuffer;
+        if (now - std::max(bc->lastFetchTime, tb.lastEditTime) >= kTextBufferCompactTime) {
+            // Saved above already, kTextBufferCompactTime is longer than kTextSaveIdleTime
+            assert(!bc->isTextStale);
+            mBatchParser->Cancel(tb);
+            tb.Compact();
+            return true;
+        }
+
+        // Buffers that are no longer edited give back the gap the last edits left behind
+        tb.ShrinkToFitIfIdle();
+        return false;
+    });
+}
+
 void Ionl::Document::ReparentBullet(Bullet& bullet, Bullet& newParent, size_t index) {
     // Update database
     // TODO simplify this convoluted logic, maybe replace PositionAfterThing logic with PositionReplace?
@@ -151,3 +228,10 @@ Ionl::Bullet* Ionl::Document::Store(Bullet bullet) {
     result->document = this;
     return result;
 }
+
+void Ionl::Document::SaveStaleText(Bullet& bullet) {
+    auto& bc = std::get<BulletContentTextual>(bullet.content.v);
+    bc.text = bc.textBuffer->gapBuffer.ExtractContent();
+    bc.isTextStale = false;
+    mStore->SetBulletContent(bullet.pbid, bullet.content);
+}
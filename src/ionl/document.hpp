@@ -1,9 +1,13 @@
 #pragma once
 
+#include <ionl/batch_parser.hpp>
+#include <ionl/text_buffer.hpp>
+
 #include <robin_hood.h>
 #include <chrono>
 #include <cstddef>
 #include <deque>
+#include <memory>
 #include <optional>
 #include <string>
 #include <variant>
@@ -32,7 +36,13 @@ enum class BulletType {
 };
 
 struct BulletContentTextual {
+    // Copy of the content that gets saved; behind `textBuffer` while `isTextStale`, see Document::MarkTextEdited()
     std::string text;
+    // Loaded when the bullet is first shown, see Document::FetchTextBuffer()
+    std::unique_ptr<TextBuffer> textBuffer = nullptr;
+    // Time of the last FetchTextBuffer(), i.e. when the bullet was last shown
+    std::chrono::steady_clock::time_point lastFetchTime = {};
+    bool isTextStale = false;
 };
 
 struct BulletContentMirror {
@@ -64,14 +74,27 @@ struct Bullet {
 
 class IBackingStore;
 class Document {
+public:
+    // Time after which TextBuffer's neither shown nor edited are compacted, see TextBuffer::Compact()
+    static constexpr std::chrono::steady_clock::duration kTextBufferCompactTime = std::chrono::minutes(1);
+    // Time without edits after which the content of an edited TextBuffer is written back to its bullet and saved
+    static constexpr std::chrono::steady_clock::duration kTextSaveIdleTime = std::chrono::seconds(1);
+
 private:
     IBackingStore* mStore;
+    TextBufferBatchParser* mBatchParser;
     std::deque<std::optional<Bullet>> mBullets; // Index by bullet's rbid
     std::vector<size_t> mFreeRbids;
     robin_hood::unordered_flat_map<Pbid, Rbid> mPtoRmap;
+    // TextBuffer's loaded since the last Update(), to be parsed together in one batch
+    std::vector<TextBuffer*> mUnparsedTextBuffers;
+    // Bullets with `BulletContentTextual::isTextStale` set
+    std::vector<Rbid> mStaleTextBullets;
+    // Textual bullets with a loaded and not compacted TextBuffer, so that Update() doesn't have to walk all of `mBullets`
+    std::vector<BulletContentTextual*> mExpandedTexts;
 
 public:
-    Document(IBackingStore& store);
+    Document(IBackingStore& store, TextBufferBatchParser& batchParser);
 
     Bullet& GetRoot();
     const Bullet& GetRoot() const;
@@ -83,12 +106,22 @@ public:
     Bullet& CreateBullet();
     void DeleteBullet(Bullet& bullet);
     void UpdateBulletContent(Bullet& bullet);
+    // Load the TextBuffer of `bc` on first use, it gets parsed in the background from the next Update(). Expands it if it was compacted.
+    TextBuffer& FetchTextBuffer(BulletContentTextual& bc);
+    // Call after editing the TextBuffer of `bullet`, instead of extracting its content on every edit: the content is saved by Update() once
+    // the edits settle down, or by SaveStaleTexts()
+    void MarkTextEdited(Bullet& bullet);
+    // Save the content of all edited TextBuffer's now, e.g. before reading the rows straight from the database or exiting
+    void SaveStaleTexts();
+    // Call once per frame before showing any bullets, this also shrinks or compacts idle TextBuffer's
+    void Update();
     /// If the old and new parent bullet is the same, behaves as-if the bullet is first removed
     /// from the parent, and then added at the given index.
     void ReparentBullet(Bullet& bullet, Bullet& newParent, size_t index);
 
 private:
     Bullet* Store(Bullet bullet);
+    void SaveStaleText(Bullet& bullet);
 };
 
 } // namespace Ionl
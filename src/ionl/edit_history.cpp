@@ -0,0 +1,149 @@
+#include "edit_history.hpp"
+
+#include <algorithm>
+#include <utility>
+
+Ionl::EditHistoryPolicy Ionl::gEditHistoryPolicy{};
+
+namespace {
+using namespace Ionl;
+
+int64_t CalcRecordMemory(const EditRecord& record) {
+    return (int64_t)(sizeof(EditRecord) + record.removedText.capacity() * sizeof(ImWchar));
+}
+
+bool ContainsNewline(std::span<const ImWchar> text) {
+    return std::find(text.begin(), text.end(), '\n') != text.end();
+}
+
+// Try to extend `last` with the edit, as if they were made in one go. Returns false if they are not adjacent keystrokes.
+bool TryMergeEdit(EditRecord& last, int64_t idx, std::span<const ImWchar> removedText, std::span<const ImWchar> insertedText) {
+    auto removedSize = (int64_t)removedText.size();
+    auto insertedSize = (int64_t)insertedText.size();
+    int64_t lastEnd = last.idx + last.insertedSize;
+
+    if (removedSize == 0 && insertedSize > 0) {
+        // Typing right after the last insertion; each line is its own step
+        if (last.insertedSize > 0 && idx == lastEnd && !ContainsNewline(insertedText)) {
+            last.insertedSize += insertedSize;
+            return true;
+        }
+        return false;
+    }
+
+    if (insertedSize == 0 && removedSize > 0) {
+        // Backspacing over what was just typed
+        if (idx + removedSize == lastEnd && removedSize <= last.insertedSize) {
+            last.insertedSize -= removedSize;
+            return true;
+        }
+        // Backspacing further back
+        if (last.insertedSize == 0 && idx + removedSize == last.idx) {
+            last.removedText.insert(last.removedText.begin(), removedText.begin(), removedText.end());
+            last.idx = idx;
+            return true;
+        }
+        // Deleting forward
+        if (last.insertedSize == 0 && idx == last.idx) {
+            last.removedText.insert(last.removedText.end(), removedText.begin(), removedText.end());
+            return true;
+        }
+    }
+
+    return false;
+}
+} // namespace
+
+void Ionl::EditHistory::Record(int64_t idx, std::span<const ImWchar> removedText, std::span<const ImWchar> insertedText) {
+    if (removedText.empty() && insertedText.empty()) {
+        return;
+    }
+
+    for (auto& record : mRedoStack) {
+        mMemoryUsage -= CalcRecordMemory(record);
+    }
+    mRedoStack.clear();
+
+    auto now = std::chrono::steady_clock::now();
+    bool isSealed = std::exchange(mIsSealed, false);
+    if (!isSealed && !mUndoStack.empty() && now - mUndoStack.back().time <= gEditHistoryPolicy.coalesceInterval) {
+        auto& last = mUndoStack.back();
+        int64_t oldMemory = CalcRecordMemory(last);
+        if (TryMergeEdit(last, idx, removedText, insertedText)) {
+            last.time = now;
+            mMemoryUsage += CalcRecordMemory(last) - oldMemory;
+            // Backspacing over everything that was typed leaves a no-op
+            if (last.insertedSize == 0 && last.removedText.empty()) {
+                mMemoryUsage -= CalcRecordMemory(last);
+                mUndoStack.pop_back();
+            }
+            EnforceMemoryLimit();
+            return;
+        }
+    }
+
+    PushUndo(EditRecord{
+        .idx = idx,
+        .insertedSize = (int64_t)insertedText.size(),
+        .removedText = std::vector<ImWchar>(removedText.begin(), removedText.end()),
+        .time = now,
+    });
+}
+
+bool Ionl::EditHistory::CanRecord(int64_t removedSize) const {
+    return (int64_t)sizeof(EditRecord) + removedSize * (int64_t)sizeof(ImWchar) <= gEditHistoryPolicy.memoryLimit;
+}
+
+void Ionl::EditHistory::Clear() {
+    mUndoStack.clear();
+    mRedoStack.clear();
+    mMemoryUsage = 0;
+    mIsSealed = false;
+}
+
+std::optional<Ionl::EditRecord> Ionl::EditHistory::TakeUndo() {
+    if (mUndoStack.empty()) {
+        return std::nullopt;
+    }
+    auto record = std::move(mUndoStack.back());
+    mUndoStack.pop_back();
+    mMemoryUsage -= CalcRecordMemory(record);
+    // Typing after an undo shouldn't merge into the record before the undone one
+    mIsSealed = true;
+    return record;
+}
+
+std::optional<Ionl::EditRecord> Ionl::EditHistory::TakeRedo() {
+    if (mRedoStack.empty()) {
+        return std::nullopt;
+    }
+    auto record = std::move(mRedoStack.back());
+    mRedoStack.pop_back();
+    mMemoryUsage -= CalcRecordMemory(record);
+    mIsSealed = true;
+    return record;
+}
+
+void Ionl::EditHistory::PushUndo(EditRecord record) {
+    mMemoryUsage += CalcRecordMemory(record);
+    mUndoStack.push_back(std::move(record));
+    EnforceMemoryLimit();
+}
+
+void Ionl::EditHistory::PushRedo(EditRecord record) {
+    mMemoryUsage += CalcRecordMemory(record);
+    mRedoStack.push_back(std::move(record));
+    EnforceMemoryLimit();
+}
+
+void Ionl::EditHistory::EnforceMemoryLimit() {
+    // NOTE: a single record larger than the limit gets dropped as well, i.e. such an edit can't be undone
+    while (mMemoryUsage > gEditHistoryPolicy.memoryLimit && !mUndoStack.empty()) {
+        mMemoryUsage -= CalcRecordMemory(mUndoStack.front());
+        mUndoStack.pop_front();
+    }
+    while (mMemoryUsage > gEditHistoryPolicy.memoryLimit && !mRedoStack.empty()) {
+        mMemoryUsage -= CalcRecordMemory(mRedoStack.front());
+        mRedoStack.pop_front();
+    }
+}
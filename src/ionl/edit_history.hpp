@@ -0,0 +1,68 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Ionl {
+
+// Limits of EditHistory, applied to each TextBuffer separately.
+struct EditHistoryPolicy {
+    // Memory of all records in one EditHistory, in bytes; the oldest records are dropped past this
+    int64_t memoryLimit = 4 * 1024 * 1024;
+    // Consecutive edits are merged into one record if they are at most this far apart
+    std::chrono::steady_clock::duration coalesceInterval = std::chrono::seconds(1);
+};
+
+extern EditHistoryPolicy gEditHistoryPolicy;
+
+// One undoable step: `removedText` at logical index `idx` was replaced by `insertedSize` chars.
+// The inserted chars are not stored, they are still in the buffer; undoing a record reads them out into the inverse record for redo.
+struct EditRecord {
+    int64_t idx = 0;
+    int64_t insertedSize = 0;
+    std::vector<ImWchar> removedText;
+    // Time of the last edit merged into this record
+    std::chrono::steady_clock::time_point time;
+};
+
+// Undo/redo journal of a TextBuffer. Consecutive keystrokes at one spot are merged into a single record.
+class EditHistory {
+private:
+    std::deque<EditRecord> mUndoStack;
+    std::deque<EditRecord> mRedoStack;
+    int64_t mMemoryUsage = 0;
+    // If set, the next edit starts a new record even if it could be merged into the last one
+    bool mIsSealed = false;
+
+public:
+    // Record that `removedText` at logical index `idx` was replaced by `insertedText`. Clears the redo stack.
+    void Record(int64_t idx, std::span<const ImWchar> removedText, std::span<const ImWchar> insertedText);
+    // Whether an edit removing `removedSize` chars fits into the memory limit at all. If not, recording it would just drop every record.
+    bool CanRecord(int64_t removedSize) const;
+    // Make the next Record() start a new undo step, e.g. after the cursor was moved away.
+    void Seal() { mIsSealed = true; }
+    void Clear();
+
+    bool CanUndo() const { return !mUndoStack.empty(); }
+    bool CanRedo() const { return !mRedoStack.empty(); }
+
+    // The caller applies the inverse of a taken record to the buffer, and pushes the inverted record onto the opposite stack; see TextBuffer::Undo()
+    std::optional<EditRecord> TakeUndo();
+    std::optional<EditRecord> TakeRedo();
+    void PushUndo(EditRecord record);
+    void PushRedo(EditRecord record);
+
+    int64_t GetMemoryUsage() const { return mMemoryUsage; }
+
+private:
+    // Drop the oldest undo records, then the farthest redo records, until under the memory limit
+    void EnforceMemoryLimit();
+};
+
+} // namespace Ionl
@@ -1,48 +1,115 @@
 #include "gap_buffer.hpp"
 
+#include <ionl/gap_buffer_allocator.hpp>
+#include <ionl/utf8.hpp>
 #include <imgui/imgui_internal.h>
 
+#include <algorithm>
+#include <bit>
 #include <cstdlib>
 #include <utility>
+#include <vector>
+
+Ionl::GapBufferGrowthPolicy Ionl::gGapBufferGrowthPolicy{};
+thread_local Ionl::GapBufferOpCounters Ionl::gGapBufferOpCounters{};
 
 static ImWchar* AllocateBuffer(size_t size) {
-    return (ImWchar*)malloc(sizeof(ImWchar) * size);
+    return (ImWchar*)Ionl::GapBufferAllocator::GetInstance().Allocate(sizeof(ImWchar) * size);
+}
+
+static void ReallocateBuffer(ImWchar*& buffer, size_t oldSize, size_t newSize) {
+    buffer = (ImWchar*)Ionl::GapBufferAllocator::GetInstance().Reallocate(buffer, sizeof(ImWchar) * oldSize, sizeof(ImWchar) * newSize);
 }
 
-static void ReallocateBuffer(ImWchar*& oldBuffer, size_t newSize) {
-    oldBuffer = (ImWchar*)realloc(oldBuffer, sizeof(ImWchar) * newSize);
+static void DeallocateBuffer(ImWchar* buffer, size_t size) {
+    Ionl::GapBufferAllocator::GetInstance().Deallocate(buffer, sizeof(ImWchar) * size);
+}
+
+// Drop one reference to storage that may be shared with GapBufferSnapshot's, freeing it if that was the last one
+static void ReleaseBuffer(ImWchar* buffer, size_t size, std::atomic<int32_t>* sharedRefCount) {
+    // Snapshots may be destroyed on any thread, whoever drops the last reference frees the storage
+    if (sharedRefCount != nullptr && sharedRefCount->fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    delete sharedRefCount;
+    DeallocateBuffer(buffer, size);
 }
 
-static void DeallocateBuffer(ImWchar* buffer) {
-    free(buffer);
+// Give `buf` its own copy of the storage if it is shared with GapBufferSnapshot's. Must be called before writing into `buf.buffer`.
+static void UnshareBuffer(Ionl::GapBuffer& buf) {
+    auto sharedRefCount = std::exchange(buf.sharedRefCount, nullptr);
+    if (sharedRefCount == nullptr) {
+        return;
+    }
+    if (sharedRefCount->load(std::memory_order_acquire) == 1) {
+        // All snapshots are gone already. New ones can only be taken from `buf` itself, so nothing else can start sharing the storage now.
+        delete sharedRefCount;
+        return;
+    }
+
+    auto copy = AllocateBuffer(buf.bufferSize);
+    std::copy(buf.PtrBegin(), buf.PtrBegin() + buf.GetFrontEnd(), copy);
+    std::copy(buf.PtrBegin() + buf.GetBackBegin(), buf.PtrEnd(), copy + buf.GetBackBegin());
+    ReleaseBuffer(buf.buffer, buf.bufferSize, sharedRefCount);
+    buf.buffer = copy;
+}
+
+// Allocations are rounded up to the allocator's size classes, the extra space might as well become part of the gap
+static int64_t GetUsableBufferSize(int64_t size) {
+    return (int64_t)(Ionl::GapBufferAllocator::GetUsableSize(sizeof(ImWchar) * size) / sizeof(ImWchar));
 }
 
 Ionl::GapBuffer::GapBuffer()
-    : buffer{ AllocateBuffer(256) }
-    , bufferSize{ 256 }
+    : buffer{ nullptr }
+    , bufferSize{ 0 }
     , frontSize{ 0 }
-    , gapSize{ 256 } {}
+    , gapSize{ 0 }
+    , sharedRefCount{ nullptr } {}
 
 Ionl::GapBuffer::GapBuffer(std::string_view content)
     // NOTE: these set of parameters are technically invalid, but they get immediately overridden by UpdateContent() which doesn't care
     : buffer{ nullptr }
     , bufferSize{ 0 }
     , frontSize{ 0 }
-    , gapSize{ 0 } //
+    , gapSize{ 0 }
+    , sharedRefCount{ nullptr } //
 {
     UpdateContent(content);
 }
 
+Ionl::GapBuffer::GapBuffer(const GapBuffer& that)
+    : buffer{ AllocateBuffer(that.bufferSize) }
+    , bufferSize{ that.bufferSize }
+    , frontSize{ that.frontSize }
+    , gapSize{ that.gapSize }
+    , lineIndex{ that.lineIndex }
+    , sharedRefCount{ nullptr } //
+{
+    std::copy(that.PtrBegin(), that.PtrBegin() + that.GetFrontEnd(), PtrBegin());
+    std::copy(that.PtrBegin() + that.GetBackBegin(), that.PtrEnd(), PtrBegin() + GetBackBegin());
+}
+
+Ionl::GapBuffer& Ionl::GapBuffer::operator=(const GapBuffer& that) {
+    if (this == &that) {
+        return *this;
+    }
+
+    return *this = GapBuffer(that);
+}
+
 Ionl::GapBuffer::GapBuffer(GapBuffer&& that) noexcept
     : buffer{ that.buffer }
     , bufferSize{ that.bufferSize }
     , frontSize{ that.frontSize }
-    , gapSize{ that.gapSize } //
+    , gapSize{ that.gapSize }
+    , lineIndex{ std::move(that.lineIndex) }
+    , sharedRefCount{ that.sharedRefCount } //
 {
     that.buffer = nullptr;
     that.bufferSize = 0;
     that.frontSize = 0;
     that.gapSize = 0;
+    that.sharedRefCount = nullptr;
 }
 
 Ionl::GapBuffer& Ionl::GapBuffer::operator=(GapBuffer&& that) noexcept {
@@ -50,17 +117,19 @@ Ionl::GapBuffer& Ionl::GapBuffer::operator=(GapBuffer&& that) noexcept {
         return *this;
     }
 
-    DeallocateBuffer(this->buffer);
+    ReleaseBuffer(this->buffer, this->bufferSize, this->sharedRefCount);
     this->buffer = std::exchange(that.buffer, nullptr);
     this->bufferSize = std::exchange(that.bufferSize, 0);
     this->frontSize = std::exchange(that.frontSize, 0);
     this->gapSize = std::exchange(that.gapSize, 0);
+    this->lineIndex = std::exchange(that.lineIndex, LineIndex());
+    this->sharedRefCount = std::exchange(that.sharedRefCount, nullptr);
 
     return *this;
 }
 
 Ionl::GapBuffer::~GapBuffer() {
-    DeallocateBuffer(buffer);
+    ReleaseBuffer(buffer, bufferSize, sharedRefCount);
 }
 
 int64_t Ionl::GapBuffer::GetLastTextIndex() const {
@@ -74,39 +143,70 @@ int64_t Ionl::GapBuffer::GetLastTextEnd() const {
 }
 
 std::string Ionl::GapBuffer::ExtractContent() const {
-    auto frontBegin = buffer;
-    auto frontEnd = buffer + frontSize;
-    auto backBegin = buffer + frontSize + gapSize;
-    auto backEnd = buffer + bufferSize;
-
-    size_t utf8Count =
-        ImTextCountUtf8BytesFromStr(frontBegin, frontEnd) +
-        ImTextCountUtf8BytesFromStr(backBegin, backEnd);
-
-    // Add 1 to string buffer size to account for null terminator
-    // ImTextStrToUtf8() writes the \0 at the end, in addition to the provided source content
-    std::string result(utf8Count, '\0');
-    size_t frontUtf8Count = ImTextStrToUtf8(result.data(), result.size() + 1, frontBegin, frontEnd);
-    size_t backUtf8Count = ImTextStrToUtf8(result.data() + frontUtf8Count, result.size() - frontUtf8Count + 1, backBegin, backEnd);
+    // Size the string by the worst case instead of counting the exact size in a separate pass over the content
+    std::string result;
+    result.resize_and_overwrite(GetContentSize() * kMaxUtf8BytesPerImWchar, [&](char* out, size_t) {
+        size_t utf8Count = 0;
+        for (auto segment : Segments()) {
+            utf8Count += TranscodeImWcharToUtf8(segment.data(), segment.data() + segment.size(), out + utf8Count);
+        }
+        return utf8Count;
+    });
 
     return result;
 }
 
 void Ionl::GapBuffer::UpdateContent(std::string_view content) {
-    auto strBegin = content.data();
-    auto strEnd = content.data() + content.size();
-    auto minBufferSize = ImTextCountCharsFromUtf8(strBegin, strEnd);
-    if (bufferSize < minBufferSize) {
-        bufferSize = minBufferSize;
-        frontSize = minBufferSize;
-        gapSize = 0;
-        ReallocateBuffer(buffer, minBufferSize);
-    } else {
-        // If new string size is smaller than our current buffer, we keep the buffer and simply put new data into it
-        frontSize = minBufferSize;
-        gapSize = bufferSize - minBufferSize;
+    // Count first instead of sizing by UTF-8 bytes, which would leave 2/3 of the buffer as gap for CJK text; counting ASCII is a vectorized skip
+    auto numChars = (int64_t)CountUtf8ToImWchar(content.data(), content.data() + content.size());
+    if (sharedRefCount != nullptr) {
+        // The old content is about to be overwritten anyways, so start over with new storage instead of copying it
+        ReleaseBuffer(buffer, bufferSize, std::exchange(sharedRefCount, nullptr));
+        buffer = nullptr;
+        bufferSize = 0;
+    }
+    if (bufferSize < numChars) {
+        auto newBufferSize = GetUsableBufferSize(numChars);
+        ReallocateBuffer(buffer, bufferSize, newBufferSize);
+        bufferSize = newBufferSize;
     }
-    ImTextStrFromUtf8NoNullTerminate(buffer, bufferSize, strBegin, strEnd);
+    frontSize = TranscodeUtf8ToImWchar(content.data(), content.data() + content.size(), buffer);
+    assert(frontSize == numChars);
+    gapSize = bufferSize - frontSize;
+    lineIndex.Rebuild(*this);
+}
+
+Ionl::GapBufferSnapshot::GapBufferSnapshot(GapBuffer& buf) {
+    if (buf.buffer == nullptr) {
+        return;
+    }
+
+    if (buf.sharedRefCount == nullptr) {
+        buf.sharedRefCount = new std::atomic<int32_t>(1);
+    }
+    buf.sharedRefCount->fetch_add(1, std::memory_order_relaxed);
+
+    mBuffer.buffer = buf.buffer;
+    mBuffer.bufferSize = buf.bufferSize;
+    mBuffer.frontSize = buf.frontSize;
+    mBuffer.gapSize = buf.gapSize;
+    mBuffer.lineIndex = buf.lineIndex;
+    mBuffer.sharedRefCount = buf.sharedRefCount;
+}
+
+int64_t Ionl::CalcGrownBufferSize(int64_t bufferSize, int64_t minimumSize) {
+    auto& policy = gGapBufferGrowthPolicy;
+    if (minimumSize > policy.doublingLimit) {
+        // Past the limit, doubling would reserve about as much again as the content, for a gap that is rarely filled up before the buffer goes idle
+        return minimumSize + policy.linearGrowthStep;
+    }
+
+    // NOTE: an empty buffer has bufferSize == 0, which would never grow by doubling
+    auto newSize = (int64_t)std::bit_ceil((uint64_t)std::max<int64_t>(bufferSize, 1));
+    while (newSize < minimumSize) {
+        newSize *= 2;
+    }
+    return newSize;
 }
 
 int64_t Ionl::MapLogicalIndexToBufferIndex(const GapBuffer& buffer, int64_t logicalIdx) {
@@ -143,9 +243,23 @@ int64_t Ionl::AdjustBufferIndex(const GapBuffer& buffer, int64_t idx, int64_t de
     }
 }
 
+int64_t Ionl::MapLogicalIndexToLine(const GapBuffer& buf, int64_t logicalIdx) {
+    return buf.lineIndex.CountNewlinesBefore(buf, logicalIdx);
+}
+
+int64_t Ionl::MapLineToLogicalIndex(const GapBuffer& buf, int64_t line) {
+    return line <= 0 ? 0 : buf.lineIndex.FindNewlineEnd(buf, line);
+}
+
+int64_t Ionl::CountLines(const GapBuffer& buf) {
+    return MapLogicalIndexToLine(buf, buf.GetContentSize()) + 1;
+}
+
 void Ionl::MoveGapToBufferIndex(Ionl::GapBuffer& buf, int64_t newIdx) {
     int64_t oldIdx = buf.GetGapBegin();
     if (oldIdx == newIdx) return;
+    UnshareBuffer(buf);
+    gGapBufferOpCounters.gapMoves += 1;
 
     // NOTE: we must use memmove() because gap size may be smaller than movement distance, in which case the src region and dst region will overlap
     if (oldIdx < newIdx) {
@@ -208,21 +322,20 @@ void Ionl::WidenGap(Ionl::GapBuffer& buf, size_t requestedGapSize) {
     // Some assumptions:
     // - Increasing the gap size means the user is editing this buffer, which means they'll probably edit it some more
     // - Hence, it's likely that this buffer will be reallocated multiple times in the future
-    // - Hence, we round buffer size to a power of 2 to reduce malloc() overhead
+    // - Hence, we round buffer size to a power of 2 to reduce the number of reallocations, up to a limit (see GapBufferGrowthPolicy)
 
     int64_t frontSize = buf.GetFrontSize();
     int64_t backSize = buf.GetBackSize();
     // `GapBuffer::gapSize` will be updated as a result of this function call
     int64_t oldGapSize = buf.GetGapSize();
 
-    int64_t newBufSize = ImUpperPowerOfTwo(buf.bufferSize);
-    int64_t minimumBufSize = buf.GetContentSize() + requestedGapSize;
-    // TODO keep a reasonable size once we get above e.g. 8KB?
-    while (newBufSize < minimumBufSize) {
-        newBufSize *= 2;
-    }
+    int64_t newBufSize = CalcGrownBufferSize(buf.bufferSize, buf.GetContentSize() + requestedGapSize);
+    newBufSize = GetUsableBufferSize(newBufSize);
 
-    ReallocateBuffer(buf.buffer, newBufSize);
+    // NOTE: this may copy the buffer only to reallocate it right away, but widening happens rarely enough that it isn't worth a separate path
+    UnshareBuffer(buf);
+    ReallocateBuffer(buf.buffer, buf.bufferSize, newBufSize);
+    gGapBufferOpCounters.widens += 1;
 
     buf.bufferSize = newBufSize;
     buf.frontSize /*keep intact*/;
@@ -234,46 +347,171 @@ void Ionl::WidenGap(Ionl::GapBuffer& buf, size_t requestedGapSize) {
         backSize * sizeof(ImWchar));
 }
 
+void Ionl::ShrinkToFit(GapBuffer& buf, size_t maxGapSize) {
+    int64_t contentSize = buf.GetContentSize();
+    int64_t newBufSize = GetUsableBufferSize(contentSize + maxGapSize);
+    if (newBufSize >= buf.bufferSize) {
+        return;
+    }
+
+    // Close the gap before reallocating, which only keeps the beginning of the buffer
+    UnshareBuffer(buf);
+    int64_t newGapSize = newBufSize - contentSize;
+    memmove(buf.buffer + buf.frontSize + newGapSize, buf.buffer + buf.GetBackBegin(), buf.GetBackSize() * sizeof(ImWchar));
+    ReallocateBuffer(buf.buffer, buf.bufferSize, newBufSize);
+
+    buf.bufferSize = newBufSize;
+    buf.gapSize = newGapSize;
+}
+
 void Ionl::InsertAtGap(GapBuffer& buf, const ImWchar* text, size_t size) {
     if (buf.GetGapSize() <= size) {
         // Add 1 to void having a 0-length gap
         WidenGap(buf, size + 1);
+    } else {
+        UnshareBuffer(buf);
     }
 
     assert(buf.gapSize > size);
     memcpy(buf.buffer + buf.GetGapBegin(), text, size * sizeof(ImWchar));
     buf.frontSize += size;
     buf.gapSize -= size;
+    buf.lineIndex.OnInserted(buf, buf.frontSize - size, size);
 }
 
 void Ionl::InsertAtGap(GapBuffer& buf, const char* text, size_t size) {
-    auto numCodepoint = ImTextCountCharsFromUtf8(text, text + size);
-    if (buf.GetBackSize() <= numCodepoint) {
-        WidenGap(buf, numCodepoint + 1);
+    auto numChars = CountUtf8ToImWchar(text, text + size);
+    if (buf.GetGapSize() <= (int64_t)numChars) {
+        WidenGap(buf, numChars + 1);
+    } else {
+        UnshareBuffer(buf);
     }
 
-    assert(buf.gapSize > numCodepoint);
-    const char* remaining;
-    ImTextStrFromUtf8NoNullTerminate(buf.buffer + buf.GetGapBegin(), buf.gapSize, text, text + size, &remaining);
-    assert(remaining == text + size);
-    buf.frontSize += numCodepoint;
-    buf.gapSize -= numCodepoint;
+    TranscodeUtf8ToImWchar(text, text + size, buf.buffer + buf.GetGapBegin());
+    buf.frontSize += numChars;
+    buf.gapSize -= numChars;
+    buf.lineIndex.OnInserted(buf, buf.frontSize - numChars, numChars);
 }
 
-void Ionl::DumpGapBuffer(const Ionl::GapBuffer& buf, std::ostream& out) {
-    for (int64_t i = buf.GetFrontBegin(); i < buf.GetFrontEnd(); ++i) {
-        char utf8[5];
-        int count = ImTextCharToUtf8Counted(utf8, buf.buffer[i]);
-        out.write(utf8, count);
+void Ionl::InsertNormalizedAtGap(GapBuffer& buf, const char* text, size_t size) {
+    auto numChars = CountUtf8ToImWcharNormalizingNewlines(text, text + size);
+    if (buf.GetGapSize() <= (int64_t)numChars) {
+        WidenGap(buf, numChars + 1);
+    } else {
+        UnshareBuffer(buf);
     }
+
+    TranscodeUtf8ToImWcharNormalizingNewlines(text, text + size, buf.buffer + buf.GetGapBegin());
+    buf.frontSize += numChars;
+    buf.gapSize -= numChars;
+    buf.lineIndex.OnInserted(buf, buf.frontSize - numChars, numChars);
+}
+
+void Ionl::EraseAfterGap(GapBuffer& buf, size_t size) {
+    assert(buf.GetBackSize() >= (int64_t)size);
+    // Only the gap grows, the storage is left untouched; hence no need to unshare it
+    buf.lineIndex.OnErasing(buf, buf.frontSize, size);
+    buf.gapSize += size;
+}
+
+void Ionl::EraseBeforeGap(GapBuffer& buf, size_t size) {
+    assert(buf.GetFrontSize() >= (int64_t)size);
+    buf.lineIndex.OnErasing(buf, buf.frontSize - size, size);
+    buf.frontSize -= size;
+    buf.gapSize += size;
+}
+
+void Ionl::EraseRange(GapBuffer& buf, int64_t begin, int64_t end) {
+    if (buf.frontSize < begin) {
+        MoveGapToLogicalIndex(buf, begin);
+    } else if (buf.frontSize > end) {
+        MoveGapToLogicalIndex(buf, end);
+    }
+
+    // The gap is now somewhere in [begin, end], grow it over both sides
+    int64_t gap = buf.frontSize;
+    EraseAfterGap(buf, end - gap);
+    EraseBeforeGap(buf, gap - begin);
+}
+
+bool Ionl::ApplyEdits(GapBuffer& buf, std::span<const GapBufferEdit> edits) {
+    if (edits.empty()) {
+        return true;
+    }
+
+    std::vector<GapBufferEdit> sorted(edits.begin(), edits.end());
+    // Pure insertions go before a removal at the same index, otherwise they would be inside the removed range
+    std::stable_sort(sorted.begin(), sorted.end(), [](const GapBufferEdit& a, const GapBufferEdit& b) {
+        return a.idx != b.idx ? a.idx < b.idx : (a.removedSize == 0 && b.removedSize != 0);
+    });
+
+    // Largest growth of the content up to any of the edits, which is how far the write position below gets ahead of where it started
+    int64_t delta = 0;
+    int64_t maxDelta = 0;
+    int64_t prevEnd = 0;
+    for (auto& edit : sorted) {
+        // Checking is cheap next to the sweep below, which would corrupt the buffer given overlapping or out of bounds edits
+        if (edit.idx < prevEnd || edit.removedSize < 0 || edit.idx + edit.removedSize > buf.GetContentSize()) {
+            return false;
+        }
+        prevEnd = edit.idx + edit.removedSize;
+        delta += (int64_t)edit.text.size() - edit.removedSize;
+        maxDelta = std::max(maxDelta, delta);
+    }
+    int64_t begin = sorted.front().idx;
+    int64_t oldEnd = sorted.back().idx + sorted.back().removedSize;
+    int64_t newEnd = oldEnd + delta;
+
+    // Everything in [begin, oldEnd) gets rewritten, account for it in the line index as a single replacement
+    buf.lineIndex.OnErasing(buf, begin, oldEnd - begin);
+
+    // The write position starts the gap size behind the read position, and must stay behind it; keep at least 1 element of gap at the end
+    if (buf.GetGapSize() <= maxDelta) {
+        WidenGap(buf, maxDelta + 1);
+    }
+    MoveGapToLogicalIndex(buf, begin);
+    UnshareBuffer(buf);
+
+    //     *******------------XX****YYY*****
+    //            ^ out       ^ in
+    // (XX and YYY being the elements removed by 2 edits.) Each unedited stretch is slid down from `in` to `out`, then the edit's text is written at `out` while its removed elements are skipped at `in`
+    ImWchar* out = buf.buffer + buf.GetGapBegin();
+    const ImWchar* in = buf.buffer + buf.GetBackBegin();
+    int64_t pos = begin;
+    for (auto& edit : sorted) {
+        int64_t keepSize = edit.idx - pos;
+        memmove(out, in, keepSize * sizeof(ImWchar));
+        out += keepSize;
+        in += keepSize + edit.removedSize;
+        if (!edit.text.empty()) {
+            memcpy(out, edit.text.data(), edit.text.size() * sizeof(ImWchar));
+            out += edit.text.size();
+        }
+        pos = edit.idx + edit.removedSize;
+    }
+
+    buf.frontSize = out - buf.buffer;
+    buf.gapSize = in - out;
+    assert(buf.frontSize == newEnd);
+    buf.lineIndex.OnInserted(buf, begin, newEnd - begin);
+    return true;
+}
+
+void Ionl::DumpGapBuffer(const Ionl::GapBuffer& buf, std::ostream& out) {
+    auto dumpSegment = [&](std::span<const ImWchar> segment) {
+        for (ImWchar c : segment) {
+            char utf8[5];
+            int count = ImTextCharToUtf8Counted(utf8, c);
+            out.write(utf8, count);
+        }
+    };
+
+    auto [front, back] = buf.Segments();
+    dumpSegment(front);
     for (int64_t i = buf.GetGapBegin(); i < buf.GetGapEnd(); ++i) {
         out.put('.');
     }
-    for (int64_t i = buf.GetBackBegin(); i < buf.GetBackEnd(); ++i) {
-        char utf8[5];
-        int count = ImTextCharToUtf8Counted(utf8, buf.buffer[i]);
-        out.write(utf8, count);
-    }
+    dumpSegment(back);
 }
 
 void Ionl::ShowGapBuffer(const Ionl::GapBuffer& buf) {
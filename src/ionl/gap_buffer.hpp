@@ -1,11 +1,16 @@
 #pragma once
 
+#include <ionl/line_index.hpp>
 #include <ionl/utils.hpp>
 #include <imgui/imgui.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
 
@@ -14,6 +19,31 @@ namespace Ionl {
 template <typename TContainer>
 struct GapBufferIterator;
 
+// How WidenGap() sizes buffers, in elements.
+struct GapBufferGrowthPolicy {
+    // Up to this size, buffers grow by doubling, so that a buffer typed into one char at a time is only reallocated a logarithmic number of times
+    int64_t doublingLimit = 64 * 1024;
+    // Above `doublingLimit`, buffers grow to the requested size plus this much instead
+    int64_t linearGrowthStep = 64 * 1024;
+};
+
+extern GapBufferGrowthPolicy gGapBufferGrowthPolicy;
+
+// Size for a buffer of `bufferSize` elements that needs to grow to at least `minimumSize`, according to gGapBufferGrowthPolicy.
+int64_t CalcGrownBufferSize(int64_t bufferSize, int64_t minimumSize);
+
+// Number of gap moves and reallocations by WidenGap() done on this thread, for tests to check what an operation costs
+struct GapBufferOpCounters {
+    int64_t gapMoves = 0;
+    int64_t widens = 0;
+};
+
+extern thread_local GapBufferOpCounters gGapBufferOpCounters;
+
+// Storage comes from GapBufferAllocator, and may be shared with GapBufferSnapshot's.
+// TODO piece table storage for large buffers edited far apart, with O(log n) insert and erase instead of a gap move per edit. This needs TextRun
+//   and GlyphRun to stop being buffer indices into contiguous storage, since layout and drawing read `&buffer[tr.begin]` directly. Until
+//   then, scattered edits should be batched through ApplyEdits(), which moves the gap once.
 struct GapBuffer {
     using iterator = GapBufferIterator<GapBuffer>;
     using const_iterator = GapBufferIterator<const GapBuffer>;
@@ -22,9 +52,19 @@ struct GapBuffer {
     int64_t bufferSize;
     int64_t frontSize;
     int64_t gapSize;
+    // Kept up to date by all the functions below that modify the buffer
+    LineIndex lineIndex;
+    // Number of GapBuffer's sharing `buffer` with GapBufferSnapshot's, nullptr if not shared
+    // NOTE: the non-const accessors don't unshare the buffer, don't write through them while a snapshot may be alive
+    std::atomic<int32_t>* sharedRefCount;
 
+    // Creates an empty buffer without allocating, the first insertion does.
     GapBuffer();
     GapBuffer(std::string_view content);
+    // Copies preserve the gap location, so that buffer indices into the original are also valid for the copy
+    GapBuffer(const GapBuffer&);
+    GapBuffer& operator=(const GapBuffer&);
+    // Copies always get their own storage, use GapBufferSnapshot to share it
     GapBuffer(GapBuffer&&) noexcept;
     GapBuffer& operator=(GapBuffer&&) noexcept;
     ~GapBuffer();
@@ -66,18 +106,71 @@ struct GapBuffer {
     int64_t GetBackEnd() const { return bufferSize; }
     int64_t GetBackSize() const { return GetBackEnd() - GetBackBegin(); }
 
-    const ImWchar& operator[](size_t i) const { return i > (size_t)frontSize ? buffer[i + gapSize] : buffer[i]; }
+    // The content in the logical range [logicalBegin, logicalEnd) as its contiguous parts before and after the gap, in order; either may be empty.
+    // Algorithms should loop over these instead of going through GapBufferIterator, which checks for the gap on every step.
+    std::array<std::span<const ImWchar>, 2> Segments(int64_t logicalBegin, int64_t logicalEnd) const {
+        int64_t frontBegin = std::min(logicalBegin, frontSize);
+        int64_t frontEnd = std::min(logicalEnd, frontSize);
+        int64_t backBegin = std::max(logicalBegin, frontSize) + gapSize;
+        int64_t backEnd = std::max(logicalEnd, frontSize) + gapSize;
+        return {
+            std::span<const ImWchar>(buffer + frontBegin, frontEnd - frontBegin),
+            std::span<const ImWchar>(buffer + backBegin, std::max<int64_t>(backEnd - backBegin, 0)),
+        };
+    }
+    std::array<std::span<const ImWchar>, 2> Segments() const { return Segments(0, GetContentSize()); }
+
+    // Call `func` with each non-empty contiguous std::span<const ImWchar> making up the content in [logicalBegin, logicalEnd), in order.
+    template <typename TFunc>
+    void ForEachSegment(int64_t logicalBegin, int64_t logicalEnd, TFunc&& func) const {
+        for (auto segment : Segments(logicalBegin, logicalEnd)) {
+            if (!segment.empty()) {
+                func(segment);
+            }
+        }
+    }
+
+    const ImWchar& operator[](size_t i) const { return i >= (size_t)frontSize ? buffer[i + gapSize] : buffer[i]; }
     ImWchar& operator[](size_t i) { return const_cast<ImWchar&>(const_cast<const GapBuffer&>(*this)[i]); }
 
     std::string ExtractContent() const;
     void UpdateContent(std::string_view content);
 };
 
+// An immutable copy of a GapBuffer, which may be read and destroyed on any thread.
+// The storage is shared, and the original copies it the first time it is written into while a snapshot is alive.
+class GapBufferSnapshot {
+private:
+    GapBuffer mBuffer;
+
+public:
+    GapBufferSnapshot() = default;
+    explicit GapBufferSnapshot(GapBuffer& buf);
+
+    // Move only, share snapshots with std::shared_ptr if they have multiple readers
+    GapBufferSnapshot(const GapBufferSnapshot&) = delete;
+    GapBufferSnapshot& operator=(const GapBufferSnapshot&) = delete;
+    GapBufferSnapshot(GapBufferSnapshot&&) noexcept = default;
+    GapBufferSnapshot& operator=(GapBufferSnapshot&&) noexcept = default;
+
+    const GapBuffer& Get() const { return mBuffer; }
+    const GapBuffer& operator*() const { return mBuffer; }
+    const GapBuffer* operator->() const { return &mBuffer; }
+};
+
 int64_t MapLogicalIndexToBufferIndex(const GapBuffer& buffer, int64_t logicalIdx);
 
 // If the buffer index does not point to a valid logical location (i.e. it points to somewhere in the gap), -1 is returned
 int64_t MapBufferIndexToLogicalIndex(const GapBuffer& buffer, int64_t bufferIdx);
 
+// Number of '\n' before logical index `logicalIdx`, i.e. the 0-based line it is on. O(log n) with `GapBuffer::lineIndex`.
+int64_t MapLogicalIndexToLine(const GapBuffer& buf, int64_t logicalIdx);
+// Logical index of the first char on the 0-based `line`, i.e. right after the `line`-th '\n'; -1 if there are not that many lines.
+// O(log n) with `GapBuffer::lineIndex`.
+int64_t MapLineToLogicalIndex(const GapBuffer& buf, int64_t line);
+// Number of lines, which is the number of '\n' plus 1.
+int64_t CountLines(const GapBuffer& buf);
+
 int64_t AdjustBufferIndex(const GapBuffer& buffer, int64_t /*buffer index*/ idx, int64_t delta);
 
 // Move the gap to where `newIdx` is. If achieving this is impossible (`newIdx` is too far back in the buffer as to require a smaller gap than existing)
@@ -87,8 +180,32 @@ void MoveGapToBufferIndex(GapBuffer& buf, int64_t newIdxBuffer);
 // In other words, `newIdx` will become the first element in the back buffer.
 void MoveGapToLogicalIndex(GapBuffer& buf, int64_t newIdxLogical);
 void WidenGap(GapBuffer& buf, size_t requestedGapSize = 0);
+// Reallocate the buffer so that the gap is at most `maxGapSize` elements, give or take rounding to the allocator's size classes.
+// Buffer indices past the gap change, like with WidenGap().
+void ShrinkToFit(GapBuffer& buf, size_t maxGapSize = 0);
 void InsertAtGap(GapBuffer& buf, const ImWchar* text, size_t size);
 void InsertAtGap(GapBuffer& buf, const char* text, size_t size);
+// Same as InsertAtGap() with UTF-8 text, additionally replacing "\r\n" and lone '\r' with '\n', for text from outside such as the clipboard.
+// The gap is widened at most once, by the number of decoded chars, and the text is decoded straight into it.
+void InsertNormalizedAtGap(GapBuffer& buf, const char* text, size_t size);
+// Remove `size` elements right after the gap by absorbing them into it, i.e. the first `size` elements of the back buffer.
+void EraseAfterGap(GapBuffer& buf, size_t size);
+// Remove `size` elements right before the gap by absorbing them into it, i.e. the last `size` elements of the front buffer.
+void EraseBeforeGap(GapBuffer& buf, size_t size);
+// Remove the logical range [begin, end) by widening the gap over it, leaving the gap at `begin`. Nothing is copied if the gap is inside or at
+// either end of the range; otherwise the gap is moved to the nearer end first, which copies only what lies between it and the range.
+void EraseRange(GapBuffer& buf, int64_t begin, int64_t end);
+
+// One of the edits applied together by ApplyEdits(): `removedSize` elements at logical index `idx` are replaced by `text`.
+struct GapBufferEdit {
+    int64_t idx = 0;
+    int64_t removedSize = 0;
+    std::span<const ImWchar> text = {};
+};
+
+// Apply all of `edits`, indexed into the content before any of them, in a single pass; the gap ends up right after the last edit.
+// Returns false without changing anything if a removed range is out of bounds or overlaps another.
+bool ApplyEdits(GapBuffer& buf, std::span<const GapBufferEdit> edits);
 
 void DumpGapBuffer(const GapBuffer& buf, std::ostream& out);
 // Show the GapBuffer's content using ImGui
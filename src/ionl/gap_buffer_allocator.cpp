@@ -0,0 +1,316 @@
+#include "gap_buffer_allocator.hpp"
+
+#if IONL_DEBUG_FEATURES
+#    include <imgui/imgui.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if _WIN32
+#    include <malloc.h>
+#endif
+
+struct Ionl::GapBufferAllocator::FreeBlock {
+    FreeBlock* next;
+};
+
+// Placed at the beginning of each slab, which is aligned to its size so that a block's slab can be found from its address
+struct Ionl::GapBufferAllocator::Slab {
+    Slab* prev;
+    Slab* next;
+    FreeBlock* freeList;
+    int sizeClass;
+    int liveBlocks;
+};
+
+namespace {
+using namespace Ionl;
+
+// Blocks start at this offset into their slab, which leaves room for the header and keeps them aligned
+constexpr size_t kSlabHeaderSize = 64;
+static_assert(kSlabHeaderSize >= sizeof(void*) * 3 + sizeof(int) * 2);
+
+void* AllocateSlabMemory() {
+#if _WIN32
+    return _aligned_malloc(GapBufferAllocator::kSlabSize, GapBufferAllocator::kSlabSize);
+#else
+    return std::aligned_alloc(GapBufferAllocator::kSlabSize, GapBufferAllocator::kSlabSize);
+#endif
+}
+
+void DeallocateSlabMemory(void* ptr) {
+#if _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+bool IsPooledSize(size_t size) {
+    return size <= GapBufferAllocator::kMaxPooledSize;
+}
+
+int GetSizeClass(size_t size) {
+    size_t blockSize = std::bit_ceil(std::max(size, GapBufferAllocator::kMinPooledSize));
+    return std::countr_zero(blockSize) - std::countr_zero(GapBufferAllocator::kMinPooledSize);
+}
+
+size_t GetBlockSize(int sizeClass) {
+    return GapBufferAllocator::kMinPooledSize << sizeClass;
+}
+
+size_t GetBlocksPerSlab(int sizeClass) {
+    return (GapBufferAllocator::kSlabSize - kSlabHeaderSize) / GetBlockSize(sizeClass);
+}
+} // namespace
+
+static_assert(GapBufferAllocator::kMaxPooledSize == GapBufferAllocator::kMinPooledSize << (GapBufferMemoryStats::kNumSizeClasses - 1));
+
+Ionl::GapBufferAllocator& Ionl::GapBufferAllocator::GetInstance() {
+    static auto instance = new GapBufferAllocator();
+    return *instance;
+}
+
+Ionl::GapBufferAllocator::GapBufferAllocator() {
+    for (int i = 0; i < GapBufferMemoryStats::kNumSizeClasses; ++i) {
+        mStats.sizeClasses[i].blockSize = GetBlockSize(i);
+    }
+}
+
+Ionl::GapBufferAllocator::~GapBufferAllocator() {
+    // Slabs with live blocks are leaked, as their blocks are still owned by someone
+    for (int i = 0; i < GapBufferMemoryStats::kNumSizeClasses; ++i) {
+        if (mSpareSlabs[i] != nullptr) {
+            DeallocateSlabMemory(mSpareSlabs[i]);
+        }
+    }
+}
+
+size_t Ionl::GapBufferAllocator::GetUsableSize(size_t size) {
+    if (size == 0 || !IsPooledSize(size)) {
+        return size;
+    }
+    return GetBlockSize(GetSizeClass(size));
+}
+
+void* Ionl::GapBufferAllocator::Allocate(size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    std::lock_guard lock(mMutex);
+    void* ptr;
+    if (IsPooledSize(size)) {
+        ptr = AllocateBlock(GetSizeClass(size));
+        mStats.bytesInUse += GetUsableSize(size);
+    } else {
+        ptr = std::malloc(size);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        mStats.bytesInUse += size;
+        mStats.bytesReserved += size;
+        mStats.largeAllocations += 1;
+    }
+    mStats.bytesRequested += size;
+    mStats.liveAllocations += 1;
+    return ptr;
+}
+
+void* Ionl::GapBufferAllocator::Reallocate(void* ptr, size_t oldSize, size_t newSize) {
+    if (ptr == nullptr || oldSize == 0) {
+        return Allocate(newSize);
+    }
+    if (newSize == 0) {
+        Deallocate(ptr, oldSize);
+        return nullptr;
+    }
+
+    if (!IsPooledSize(oldSize) && !IsPooledSize(newSize)) {
+        // realloc() can often grow in place, or remap pages without copying for very large sizes
+        void* newPtr = std::realloc(ptr, newSize);
+        if (newPtr == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        std::lock_guard lock(mMutex);
+        auto delta = (int64_t)newSize - (int64_t)oldSize;
+        mStats.bytesRequested += delta;
+        mStats.bytesInUse += delta;
+        mStats.bytesReserved += delta;
+        return newPtr;
+    }
+
+    if (IsPooledSize(oldSize) && IsPooledSize(newSize) && GetSizeClass(oldSize) == GetSizeClass(newSize)) {
+        std::lock_guard lock(mMutex);
+        mStats.bytesRequested += (int64_t)newSize - (int64_t)oldSize;
+        return ptr;
+    }
+
+    void* newPtr = Allocate(newSize);
+    memcpy(newPtr, ptr, std::min(oldSize, newSize));
+    Deallocate(ptr, oldSize);
+    return newPtr;
+}
+
+void Ionl::GapBufferAllocator::Deallocate(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    std::lock_guard lock(mMutex);
+    if (IsPooledSize(size)) {
+        DeallocateBlock(ptr, GetSizeClass(size));
+        mStats.bytesInUse -= GetUsableSize(size);
+    } else {
+        std::free(ptr);
+        mStats.bytesInUse -= size;
+        mStats.bytesReserved -= size;
+        mStats.largeAllocations -= 1;
+    }
+    mStats.bytesRequested -= size;
+    mStats.liveAllocations -= 1;
+}
+
+Ionl::GapBufferMemoryStats Ionl::GapBufferAllocator::GetStats() const {
+    std::lock_guard lock(mMutex);
+    return mStats;
+}
+
+void* Ionl::GapBufferAllocator::AllocateBlock(int sizeClass) {
+    auto& classStats = mStats.sizeClasses[sizeClass];
+
+    Slab* slab = mPartialSlabs[sizeClass];
+    if (slab == nullptr) {
+        slab = std::exchange(mSpareSlabs[sizeClass], nullptr);
+    }
+    if (slab == nullptr) {
+        slab = static_cast<Slab*>(AllocateSlabMemory());
+        if (slab == nullptr) {
+            throw std::bad_alloc();
+        }
+        slab->sizeClass = sizeClass;
+        slab->liveBlocks = 0;
+
+        // Thread all blocks into the free list, in address order
+        auto blocks = reinterpret_cast<std::byte*>(slab) + kSlabHeaderSize;
+        size_t blockSize = GetBlockSize(sizeClass);
+        FreeBlock* head = nullptr;
+        for (size_t i = GetBlocksPerSlab(sizeClass); i > 0; --i) {
+            auto block = reinterpret_cast<FreeBlock*>(blocks + (i - 1) * blockSize);
+            block->next = head;
+            head = block;
+        }
+        slab->freeList = head;
+
+        classStats.slabs += 1;
+        mStats.bytesReserved += kSlabSize;
+    }
+
+    if (slab != mPartialSlabs[sizeClass]) {
+        slab->prev = nullptr;
+        slab->next = mPartialSlabs[sizeClass];
+        if (slab->next != nullptr) {
+            slab->next->prev = slab;
+        }
+        mPartialSlabs[sizeClass] = slab;
+    }
+
+    FreeBlock* block = slab->freeList;
+    slab->freeList = block->next;
+    slab->liveBlocks += 1;
+    classStats.liveBlocks += 1;
+
+    // Full slabs aren't linked anywhere until a block is freed
+    if (slab->freeList == nullptr) {
+        mPartialSlabs[sizeClass] = slab->next;
+        if (slab->next != nullptr) {
+            slab->next->prev = nullptr;
+        }
+    }
+
+    return block;
+}
+
+void Ionl::GapBufferAllocator::DeallocateBlock(void* ptr, int sizeClass) {
+    auto slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)(kSlabSize - 1));
+    assert(slab->sizeClass == sizeClass);
+    auto& classStats = mStats.sizeClasses[sizeClass];
+
+    bool wasFull = slab->freeList == nullptr;
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = slab->freeList;
+    slab->freeList = block;
+    slab->liveBlocks -= 1;
+    classStats.liveBlocks -= 1;
+
+    if (wasFull) {
+        slab->prev = nullptr;
+        slab->next = mPartialSlabs[sizeClass];
+        if (slab->next != nullptr) {
+            slab->next->prev = slab;
+        }
+        mPartialSlabs[sizeClass] = slab;
+    }
+
+    if (slab->liveBlocks == 0) {
+        // Unlink from the partial list
+        if (slab->prev != nullptr) {
+            slab->prev->next = slab->next;
+        } else {
+            mPartialSlabs[sizeClass] = slab->next;
+        }
+        if (slab->next != nullptr) {
+            slab->next->prev = slab->prev;
+        }
+
+        if (mSpareSlabs[sizeClass] == nullptr) {
+            mSpareSlabs[sizeClass] = slab;
+        } else {
+            DeallocateSlabMemory(slab);
+            classStats.slabs -= 1;
+            mStats.bytesReserved -= kSlabSize;
+        }
+    }
+}
+
+#if IONL_DEBUG_FEATURES
+void Ionl::ShowGapBufferMemoryStats(const GapBufferMemoryStats& stats) {
+    constexpr double kKiB = 1024.0;
+    ImGui::Text("Live allocations: %lld (%lld large)", (long long)stats.liveAllocations, (long long)stats.largeAllocations);
+    ImGui::Text("Requested: %.1f KiB", stats.bytesRequested / kKiB);
+    ImGui::Text("In use:    %.1f KiB", stats.bytesInUse / kKiB);
+    ImGui::Text("Reserved:  %.1f KiB", stats.bytesReserved / kKiB);
+
+    if (ImGui::BeginTable("SizeClasses", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Block size");
+        ImGui::TableSetupColumn("Live blocks");
+        ImGui::TableSetupColumn("Slabs");
+        ImGui::TableSetupColumn("Occupancy");
+        ImGui::TableHeadersRow();
+
+        for (auto& sizeClass : stats.sizeClasses) {
+            auto capacity = sizeClass.slabs * (int64_t)((GapBufferAllocator::kSlabSize - kSlabHeaderSize) / sizeClass.blockSize);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", sizeClass.blockSize);
+            ImGui::TableNextColumn();
+            ImGui::Text("%lld", (long long)sizeClass.liveBlocks);
+            ImGui::TableNextColumn();
+            ImGui::Text("%lld", (long long)sizeClass.slabs);
+            ImGui::TableNextColumn();
+            if (capacity > 0) {
+                ImGui::Text("%.0f%%", 100.0 * sizeClass.liveBlocks / capacity);
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace Ionl {
+
+struct GapBufferMemoryStats {
+    struct SizeClass {
+        size_t blockSize = 0;
+        int64_t liveBlocks = 0;
+        int64_t slabs = 0;
+    };
+
+    static constexpr int kNumSizeClasses = 9;
+    SizeClass sizeClasses[kNumSizeClasses];
+
+    // Sum of the sizes asked for by all live allocations
+    int64_t bytesRequested = 0;
+    // Sum of the sizes of the blocks handed out, i.e. `bytesRequested` plus rounding to size classes
+    int64_t bytesInUse = 0;
+    // Memory held from the system, including free blocks in slabs
+    int64_t bytesReserved = 0;
+    int64_t liveAllocations = 0;
+    int64_t largeAllocations = 0;
+};
+
+// Backing storage for GapBuffer. Sizes up to kMaxPooledSize come from slabs of power of 2 sized blocks, larger ones from malloc().
+// Thread safe, since GapBufferSnapshot's may free their storage on any thread.
+class GapBufferAllocator {
+public:
+    static constexpr size_t kMinPooledSize = 32;
+    static constexpr size_t kMaxPooledSize = 8 * 1024;
+    static constexpr size_t kSlabSize = 64 * 1024;
+
+private:
+    struct FreeBlock;
+    struct Slab;
+
+    // Slabs with at least one free block, per size class
+    Slab* mPartialSlabs[GapBufferMemoryStats::kNumSizeClasses] = {};
+    // An empty slab kept for each size class instead of releasing it
+    Slab* mSpareSlabs[GapBufferMemoryStats::kNumSizeClasses] = {};
+    GapBufferMemoryStats mStats;
+    mutable std::mutex mMutex;
+
+public:
+    // The allocator used by all gap buffers. It is never destroyed, so that buffers in static storage can be freed in any order at exit.
+    static GapBufferAllocator& GetInstance();
+
+    GapBufferAllocator();
+    ~GapBufferAllocator();
+
+    GapBufferAllocator(const GapBufferAllocator&) = delete;
+    GapBufferAllocator& operator=(const GapBufferAllocator&) = delete;
+
+    // The size actually available for an allocation of `size` bytes, callers may use all of it.
+    static size_t GetUsableSize(size_t size);
+
+    // Returns nullptr if `size` is 0.
+    void* Allocate(size_t size);
+    // Like realloc(), the first `min(oldSize, newSize)` bytes are preserved.
+    void* Reallocate(void* ptr, size_t oldSize, size_t newSize);
+    void Deallocate(void* ptr, size_t size);
+
+    GapBufferMemoryStats GetStats() const;
+
+private:
+    void* AllocateBlock(int sizeClass);
+    void DeallocateBlock(void* ptr, int sizeClass);
+};
+
+#if IONL_DEBUG_FEATURES
+void ShowGapBufferMemoryStats(const GapBufferMemoryStats& stats);
+#endif
+
+} // namespace Ionl
@@ -0,0 +1,247 @@
+#include "line_index.hpp"
+
+#include <ionl/char_search.hpp>
+#include <ionl/gap_buffer.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+using namespace Ionl;
+
+int32_t CountNewlines(const GapBuffer& buf, int64_t begin, int64_t end) {
+    int64_t result = 0;
+    buf.ForEachSegment(begin, end, [&](std::span<const ImWchar> segment) {
+        result += CountOf<'\n'>(segment.data(), segment.data() + segment.size());
+    });
+    return (int32_t)result;
+}
+
+void FenwickAdd(std::vector<int32_t>& tree, int64_t idx, int32_t delta) {
+    for (; idx < (int64_t)tree.size(); idx |= idx + 1) {
+        tree[idx] += delta;
+    }
+}
+
+// Sum of the first `count` values
+int64_t FenwickPrefix(const std::vector<int32_t>& tree, int64_t count) {
+    int64_t result = 0;
+    for (int64_t i = std::min<int64_t>(count, tree.size()) - 1; i >= 0; i = (i & (i + 1)) - 1) {
+        result += tree[i];
+    }
+    return result;
+}
+
+// Find the smallest `i` such that the sum of the first `i + 1` values is at least `target`, and the sum of the first `i` values.
+// Returns the number of values if their total is less than `target`.
+int64_t FenwickSearch(const std::vector<int32_t>& tree, int64_t target, int64_t& outSumBefore) {
+    auto size = (int64_t)tree.size();
+    int64_t idx = 0;
+    int64_t sum = 0;
+    for (int64_t step = size > 0 ? (int64_t)std::bit_floor((uint64_t)size) : 0; step > 0; step /= 2) {
+        int64_t next = idx + step;
+        if (next <= size && sum + tree[next - 1] < target) {
+            idx = next;
+            sum += tree[next - 1];
+        }
+    }
+    outSumBefore = sum;
+    return idx;
+}
+
+void FenwickBuild(std::vector<int32_t>& tree, const std::vector<int32_t>& values) {
+    tree = values;
+    auto size = (int64_t)tree.size();
+    for (int64_t i = 0; i < size; ++i) {
+        // Linear time construction: push each node's total into its parent
+        int64_t parent = i | (i + 1);
+        if (parent < size) {
+            tree[parent] += tree[i];
+        }
+    }
+}
+} // namespace
+
+void Ionl::LineIndex::Rebuild(const GapBuffer& buf) {
+    int64_t contentSize = buf.GetContentSize();
+    if (contentSize < kMinIndexedSize) {
+        Deactivate();
+        return;
+    }
+
+    mChunkSizes.clear();
+    mChunkNewlines.clear();
+    for (int64_t begin = 0; begin < contentSize; begin += kChunkSize) {
+        int64_t end = std::min(begin + kChunkSize, contentSize);
+        mChunkSizes.push_back((int32_t)(end - begin));
+        mChunkNewlines.push_back(CountNewlines(buf, begin, end));
+    }
+    RebuildTrees();
+}
+
+void Ionl::LineIndex::OnInserted(const GapBuffer& buf, int64_t idx, int64_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (!IsActive()) {
+        if (buf.GetContentSize() >= kMinIndexedSize) {
+            Rebuild(buf);
+        }
+        return;
+    }
+
+    int64_t chunkBegin;
+    int64_t chunk = FindChunk(idx, chunkBegin);
+    AddToChunk(chunk, (int32_t)size, CountNewlines(buf, idx, idx + size));
+    if (mChunkSizes[chunk] > 2 * kChunkSize) {
+        SplitChunk(buf, chunk, chunkBegin);
+    }
+}
+
+void Ionl::LineIndex::OnErasing(const GapBuffer& buf, int64_t idx, int64_t size) {
+    if (size == 0 || !IsActive()) {
+        return;
+    }
+    if (buf.GetContentSize() - size < kMinIndexedSize) {
+        // Small enough to be scanned instead, e.g. after select all and delete
+        Deactivate();
+        return;
+    }
+
+    int64_t end = idx + size;
+    int64_t chunkBegin, lastChunkBegin;
+    int64_t chunk = FindChunk(idx, chunkBegin);
+    int64_t lastChunk = FindChunk(end - 1, lastChunkBegin);
+    // For large erasures (e.g. select all and delete), rebuilding the trees once is cheaper than updating them per chunk
+    bool isBulk = lastChunk - chunk >= kMaxTreeUpdatesPerErase;
+    while (idx < end) {
+        int64_t chunkEnd = chunkBegin + mChunkSizes[chunk];
+        int64_t overlapEnd = std::min(end, chunkEnd);
+        if (overlapEnd > idx) {
+            // Only the chunks at either end of the range may be partially erased, the ones in between are dropped using their counts
+            bool isWholeChunk = idx == chunkBegin && overlapEnd == chunkEnd;
+            auto sizeDelta = -(int32_t)(overlapEnd - idx);
+            auto newlinesDelta = isWholeChunk ? -mChunkNewlines[chunk] : -CountNewlines(buf, idx, overlapEnd);
+            if (isBulk) {
+                mChunkSizes[chunk] += sizeDelta;
+                mChunkNewlines[chunk] += newlinesDelta;
+            } else {
+                AddToChunk(chunk, sizeDelta, newlinesDelta);
+            }
+            idx = overlapEnd;
+        }
+        chunkBegin = chunkEnd;
+        chunk += 1;
+    }
+    if (isBulk) {
+        RebuildTrees();
+    }
+
+    int64_t newContentSize = buf.GetContentSize() - size;
+    if ((int64_t)mChunkSizes.size() > 2 * (newContentSize / kChunkSize) + 2) {
+        MergeChunks();
+    }
+}
+
+int64_t Ionl::LineIndex::CountNewlinesBefore(const GapBuffer& buf, int64_t idx) const {
+    idx = std::clamp<int64_t>(idx, 0, buf.GetContentSize());
+    if (!IsActive()) {
+        return CountNewlines(buf, 0, idx);
+    }
+
+    int64_t chunkBegin;
+    int64_t chunk = FindChunk(idx, chunkBegin);
+    return FenwickPrefix(mNewlineTree, chunk) + CountNewlines(buf, chunkBegin, idx);
+}
+
+int64_t Ionl::LineIndex::FindNewlineEnd(const GapBuffer& buf, int64_t n) const {
+    int64_t begin = 0;
+    int64_t remaining = n;
+    if (IsActive()) {
+        int64_t newlinesBefore;
+        int64_t chunk = FenwickSearch(mNewlineTree, n, newlinesBefore);
+        if (chunk == (int64_t)mChunkNewlines.size()) {
+            return -1;
+        }
+        begin = FenwickPrefix(mSizeTree, chunk);
+        remaining -= newlinesBefore;
+    }
+
+    int64_t contentSize = buf.GetContentSize();
+    while (true) {
+        int64_t idx = FindNextOf<'\n'>(buf, begin, contentSize);
+        if (idx == contentSize) {
+            return -1;
+        }
+        if (--remaining == 0) {
+            return idx + 1;
+        }
+        begin = idx + 1;
+    }
+}
+
+int64_t Ionl::LineIndex::FindChunk(int64_t idx, int64_t& outChunkBegin) const {
+    int64_t chunk = FenwickSearch(mSizeTree, idx + 1, outChunkBegin);
+    if (chunk == (int64_t)mChunkSizes.size()) {
+        chunk -= 1;
+        outChunkBegin -= mChunkSizes[chunk];
+    }
+    return chunk;
+}
+
+void Ionl::LineIndex::AddToChunk(int64_t chunk, int32_t sizeDelta, int32_t newlinesDelta) {
+    mChunkSizes[chunk] += sizeDelta;
+    FenwickAdd(mSizeTree, chunk, sizeDelta);
+    if (newlinesDelta != 0) {
+        mChunkNewlines[chunk] += newlinesDelta;
+        FenwickAdd(mNewlineTree, chunk, newlinesDelta);
+    }
+}
+
+void Ionl::LineIndex::SplitChunk(const GapBuffer& buf, int64_t chunk, int64_t chunkBegin) {
+    int64_t chunkEnd = chunkBegin + mChunkSizes[chunk];
+
+    std::vector<int32_t> sizes;
+    std::vector<int32_t> newlines;
+    for (int64_t begin = chunkBegin; begin < chunkEnd; begin += kChunkSize) {
+        int64_t end = std::min(begin + kChunkSize, chunkEnd);
+        sizes.push_back((int32_t)(end - begin));
+        newlines.push_back(CountNewlines(buf, begin, end));
+    }
+
+    // Inserting into the middle of the arrays is linear in the number of chunks, but that is still a small fraction of the content size
+    mChunkSizes[chunk] = sizes[0];
+    mChunkNewlines[chunk] = newlines[0];
+    mChunkSizes.insert(mChunkSizes.begin() + chunk + 1, sizes.begin() + 1, sizes.end());
+    mChunkNewlines.insert(mChunkNewlines.begin() + chunk + 1, newlines.begin() + 1, newlines.end());
+    RebuildTrees();
+}
+
+void Ionl::LineIndex::MergeChunks() {
+    size_t numMerged = 0;
+    for (size_t i = 0; i < mChunkSizes.size(); ++i) {
+        if (numMerged > 0 && mChunkSizes[numMerged - 1] + mChunkSizes[i] <= kChunkSize) {
+            mChunkSizes[numMerged - 1] += mChunkSizes[i];
+            mChunkNewlines[numMerged - 1] += mChunkNewlines[i];
+        } else {
+            mChunkSizes[numMerged] = mChunkSizes[i];
+            mChunkNewlines[numMerged] = mChunkNewlines[i];
+            numMerged += 1;
+        }
+    }
+    mChunkSizes.resize(numMerged);
+    mChunkNewlines.resize(numMerged);
+    RebuildTrees();
+}
+
+void Ionl::LineIndex::Deactivate() {
+    FreeMemory(mChunkSizes);
+    FreeMemory(mChunkNewlines);
+    FreeMemory(mSizeTree);
+    FreeMemory(mNewlineTree);
+}
+
+void Ionl::LineIndex::RebuildTrees() {
+    FenwickBuild(mSizeTree, mChunkSizes);
+    FenwickBuild(mNewlineTree, mChunkNewlines);
+}
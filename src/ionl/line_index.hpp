@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Ionl {
+
+struct GapBuffer;
+
+// Char and '\n' counts per chunk of a GapBuffer's logical content, with Fenwick trees for O(log n) mapping between indices and lines.
+// Buffers shorter than kMinIndexedSize are scanned instead.
+class LineIndex {
+public:
+    static constexpr int64_t kChunkSize = 256;
+    static constexpr int64_t kMinIndexedSize = 4 * kChunkSize;
+    // Erasures spanning more chunks than this rebuild the Fenwick trees instead of updating them per chunk
+    static constexpr int64_t kMaxTreeUpdatesPerErase = 16;
+
+private:
+    std::vector<int32_t> mChunkSizes;
+    std::vector<int32_t> mChunkNewlines;
+    // Fenwick trees over the above, 1-based trees stored 0-based
+    std::vector<int32_t> mSizeTree;
+    std::vector<int32_t> mNewlineTree;
+
+public:
+    // Recount the entire content of `buf`.
+    void Rebuild(const GapBuffer& buf);
+    // Account for `size` chars that were just inserted at logical index `idx` of `buf`.
+    void OnInserted(const GapBuffer& buf, int64_t idx, int64_t size);
+    // Account for `size` chars at logical index `idx` of `buf` that are about to be erased.
+    void OnErasing(const GapBuffer& buf, int64_t idx, int64_t size);
+
+    // Number of '\n' before logical index `idx`.
+    int64_t CountNewlinesBefore(const GapBuffer& buf, int64_t idx) const;
+    // Logical index right after the `n`-th (1-based) '\n', or -1 if there are less than `n`.
+    int64_t FindNewlineEnd(const GapBuffer& buf, int64_t n) const;
+
+private:
+    bool IsActive() const { return !mChunkSizes.empty(); }
+    // Find the chunk containing logical index `idx` and the logical index it begins at; an index at the end of the content is in the last chunk
+    int64_t FindChunk(int64_t idx, int64_t& outChunkBegin) const;
+    void AddToChunk(int64_t chunk, int32_t sizeDelta, int32_t newlinesDelta);
+    // Replace `chunk` with chunks of kChunkSize, counted from its content in `buf`
+    void SplitChunk(const GapBuffer& buf, int64_t chunk, int64_t chunkBegin);
+    // Merge runs of small chunks left behind by erasures
+    void MergeChunks();
+    void RebuildTrees();
+    // Drop all chunks, so that the buffer gets scanned instead
+    void Deactivate();
+};
+
+} // namespace Ionl
@@ -1,8 +1,15 @@
 #include <ionl/backing_store.hpp>
+#include <ionl/batch_parser.hpp>
 #include <ionl/config.hpp>
 #include <ionl/document.hpp>
+#include <ionl/edit_history.hpp>
+#include <ionl/gap_buffer.hpp>
+#include <ionl/gap_buffer_allocator.hpp>
+#include <ionl/notebook_replace.hpp>
 #include <ionl/utils.hpp>
 #include <ionl/widget_misc.hpp>
+#include <ionl/widget_text_edit.hpp>
+#include <ionl/worker_pool.hpp>
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
@@ -22,7 +29,12 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include <robin_hood.h>
+
+#include <chrono>
+#include <cinttypes>
 #include <cstring>
+#include <optional>
 #include <stdexcept>
 #include <string>
 
@@ -38,6 +50,8 @@ class DocumentView {
 private:
     Document* mDocument;
     Bullet* mCurrentBullet;
+    // Editing state of each shown textual bullet; the Document only holds the content
+    robin_hood::unordered_node_map<Pbid, TextEdit> mTextEdits;
 
 public:
     DocumentView(Document& doc);
@@ -61,6 +75,7 @@ constexpr int kConfMaxFetchDepth = 6;
 
 struct ShowContext {
     Document* document;
+    robin_hood::unordered_node_map<Pbid, TextEdit>* textEdits;
     Bullet* rootBullet;
     int depth = 0;
     int count = 0;
@@ -197,14 +212,19 @@ static void ShowBulletIcon(ShowContext& gctx, BulletContext& bctx) {
 }
 
 static void ShowBulletContent(ShowContext& gctx, BulletContext& bctx) {
-    // TODO replace with TextEdit
     auto& bullet = *bctx.bullet;
     ImGui::PushID(bctx.id);
     ::VisitVariantOverloaded(
         bullet.content.v,
         [&](BulletContentTextual& bc) {
-            if (ImGui::InputText("##BulletContent", &bc.text)) {
-                bullet.document->UpdateBulletContent(bullet);
+            auto& tb = gctx.document->FetchTextBuffer(bc);
+            auto [it, _] = gctx.textEdits->try_emplace(bullet.pbid, ImGui::GetID("##BulletContent"), tb);
+            auto& te = it->second;
+
+            auto lastEditTime = tb.lastEditTime;
+            te.Show();
+            if (tb.lastEditTime != lastEditTime) {
+                bullet.document->MarkTextEdited(bullet);
             }
         },
         [&](BulletContentMirror& bc) {
@@ -261,8 +281,20 @@ static void ShowBullet(ShowContext& gctx, BulletContext& bctx) {
 }
 
 void DocumentView::Show() {
+    // Drop the TextEdit's of deleted bullets, and of compacted TextBuffer's which get laid out from scratch once expanded anyways
+    for (auto it = mTextEdits.begin(); it != mTextEdits.end();) {
+        auto bullet = mDocument->GetBulletByPbid(it->first);
+        auto bc = bullet ? std::get_if<BulletContentTextual>(&bullet->content.v) : nullptr;
+        if (bc && bc->textBuffer.get() == it->second._tb && !bc->textBuffer->isCompacted) {
+            ++it;
+        } else {
+            it = mTextEdits.erase(it);
+        }
+    }
+
     ShowContext gctx;
     gctx.document = mDocument;
+    gctx.textEdits = &mTextEdits;
     gctx.rootBullet = mCurrentBullet;
 
     BulletContext bctx;
@@ -284,16 +316,28 @@ struct AppView {
     bool windowOpen = true;
 };
 
+struct FindReplaceState {
+    std::string find;
+    std::string replacement;
+    bool caseInsensitive = false;
+    bool windowOpen = false;
+    std::optional<Ionl::NotebookReplaceResult> lastResult;
+    double lastTimeMs = 0.0;
+};
+
 struct AppState {
     Ionl::SQLiteBackingStore storeActual;
     Ionl::WriteDelayedBackingStore storeFacade;
+    Ionl::WorkerPool workerPool;
+    Ionl::TextBufferBatchParser batchParser{ workerPool };
     Ionl::Document document;
     std::vector<AppView> views;
+    FindReplaceState findReplace;
 
     AppState()
         : storeActual("./notebook.sqlite3")
         , storeFacade(storeActual)
-        , document(storeActual) //
+        , document(storeActual, batchParser) //
     {
         views.push_back(AppView{
             .view = DocumentView(document),
@@ -312,7 +356,39 @@ static const std::string& ResolveContentToText(Ionl::Document& document, const I
     throw std::runtime_error("");
 }
 
-#include <ionl/widget_text_edit.hpp>
+static void ShowFindReplaceWindow(AppState& as) {
+    auto& fr = as.findReplace;
+    auto& io = ImGui::GetIO();
+    if (io.KeyCtrl && io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_H, false)) {
+        fr.windowOpen = true;
+    }
+    if (!fr.windowOpen) {
+        return;
+    }
+
+    if (ImGui::Begin("Find & replace", &fr.windowOpen)) {
+        ImGui::InputText("Find", &fr.find);
+        ImGui::InputText("Replace with", &fr.replacement);
+        ImGui::Checkbox("Case insensitive", &fr.caseInsensitive);
+
+        ImGui::BeginDisabled(fr.find.empty());
+        if (ImGui::Button("Replace all")) {
+            // The rows are read straight from the database, so edits still queued up would be read stale and then overwritten
+            as.document.SaveStaleTexts();
+            as.storeFacade.FlushOps();
+
+            auto begin = std::chrono::steady_clock::now();
+            fr.lastResult = ReplaceInNotebook(as.document, as.storeActual, as.workerPool, fr.find, fr.replacement, { .caseInsensitive = fr.caseInsensitive });
+            fr.lastTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        }
+        ImGui::EndDisabled();
+
+        if (auto& res = fr.lastResult) {
+            ImGui::Text("Replaced %" PRId64 " occurrences in %" PRId64 " bullets (%" PRId64 " scanned) in %.1f ms", res->numReplacements, res->numBulletsChanged, res->numBulletsScanned, fr.lastTimeMs);
+        }
+    }
+    ImGui::End();
+}
 
 static void ShowAppViews(AppState& as) {
     for (size_t i = 0; i < as.views.size(); ++i) {
@@ -362,8 +438,17 @@ int main() {
 ```
 )"""sv.substr(1); // Remove initial \n
 
-        static auto textBuffer = TextBuffer(GapBuffer(kExampleText));
+        static auto textBuffer = TextBuffer(GapBuffer(kExampleText), false);
         static auto textEdit = TextEdit(ImGui::GetID("TextEdit"), textBuffer);
+        static bool textBufferSubmitted = false;
+        if (!textBufferSubmitted) {
+            as.batchParser.Submit(textBuffer);
+            textBufferSubmitted = true;
+        }
+
+        if (ImGui::CollapsingHeader("GapBuffer memory")) {
+            ShowGapBufferMemoryStats(GapBufferAllocator::GetInstance().GetStats());
+        }
 
         textEdit.Show();
     }
@@ -373,6 +458,14 @@ int main() {
 
 int main() {
     LoadConfigFromFile(gConfig, fs::path("./config.toml"));
+    gGapBufferGrowthPolicy = {
+        .doublingLimit = gConfig.gapBufferDoublingLimit,
+        .linearGrowthStep = gConfig.gapBufferLinearGrowthStep,
+    };
+    gEditHistoryPolicy = {
+        .memoryLimit = gConfig.undoMemoryLimit,
+        .coalesceInterval = std::chrono::milliseconds(gConfig.undoCoalesceIntervalMs),
+    };
 
     if (!glfwInit()) {
         return -1;
@@ -449,11 +542,16 @@ int main() {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // Frame boundary: nothing is holding onto the previous frame's cached data anymore
+        as.batchParser.InstallResults();
+        as.document.Update();
+
         double currTime = glfwGetTime();
         // "ufops" stands for UnFlushed OPerationS
         auto ufopsCntBeforeFrame = as.storeFacade.GetUnflushedOpsCount();
 
         ShowAppViews(as);
+        ShowFindReplaceWindow(as);
         ImGui::ShowDemoWindow();
         auto ufopsCntAfterFrame = as.storeFacade.GetUnflushedOpsCount();
 
@@ -483,6 +581,7 @@ int main() {
         }
     }
 
+    as.document.SaveStaleTexts();
     if (as.storeFacade.GetUnflushedOpsCount() > 0) {
         as.storeFacade.FlushOps();
     }
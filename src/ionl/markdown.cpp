@@ -1,5 +1,6 @@
 #include "markdown.hpp"
 
+#include <ionl/char_search.hpp>
 #include <ionl/macros.hpp>
 
 #include <algorithm>
@@ -9,6 +10,35 @@
 
 using namespace std::literals;
 
+namespace {
+using namespace Ionl;
+
+// Find the next char that may change the parser's state. Everything else is plain text, which the parser simply walks over.
+// NOTE: '#' is not included, because it's only meaningful at the beginning of a line, i.e. right after a '\n' which is always stopped at.
+int64_t FindNextControlChar(const GapBuffer& buf, int64_t begin, int64_t end) {
+    return FindNextOf<'`', '*', '_', '~', '\\', '\n'>(buf, begin, end);
+}
+} // namespace
+
+int Ionl::CalcHeadingLevel(TextStyleType type) {
+    auto n = static_cast<int>(type);
+    return n - static_cast<int>(TextStyleType::Title_BEGIN) + 1;
+}
+
+Ionl::TextStyleType Ionl::MakeHeadingLevel(int level) {
+    if (level == 0) {
+        return TextStyleType::Regular;
+    } else {
+        return static_cast<TextStyleType>(static_cast<int>(TextStyleType::Title_BEGIN) + level - 1);
+    }
+}
+
+bool Ionl::IsHeading(TextStyleType type) {
+    auto n = static_cast<int>(type);
+    return n >= static_cast<int>(TextStyleType::Title_BEGIN) &&
+        n < static_cast<int>(TextStyleType::Title_END);
+}
+
 static size_t AmalgamateVariantFlags(bool isMonospace, bool isBold, bool isItalic) {
     size_t idx = 0;
     idx |= isMonospace << 0;
@@ -32,7 +62,7 @@ void Ionl::MarkdownStylesheet::SetHeadingFace(MarkdownFace face, int level) {
 
 const Ionl::MarkdownFace& Ionl::MarkdownStylesheet::LookupFace(const TextStyle& style) const {
     if (IsHeading(style.type)) {
-        return headingFaces[CalcHeadingLevel(style.type)];
+        return headingFaces[CalcHeadingLevel(style.type) - 1];
     } else {
         return regularFaces[AmalgamateVariantFlags(style.isMonospace, style.isBold, style.isItalic)];
     }
@@ -56,93 +86,75 @@ Ionl::MarkdownStylesheet Ionl::gMarkdownStylesheet{};
 //     b---- "**"
 //     ----- " finishing words"
 
-Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
-    MdParseOutput out;
-
+void Ionl::MdParser::Parse(const MdParseInput& in, std::vector<TextRun>& out) {
     // TODO handle cases like ***bold and italic***, the current greedy matching method parses it as **/*text**/* which breaks the control seq pairing logic
     //      note this is also broken in irccloud-format-helper, so that won't help
 
-    // TODO break parsing state on paragraph break
-    // TODO handle code blocks
-
     // TODO might be an idea to adopt GFM, i.e. do paragraph break only on 2 or more consecutive \n, a single \n is simply ignored for formatting
     //      but this might not be that useful since we are not performing rendering on this
 
-    constexpr auto kInvalidTokenIdx = std::numeric_limits<size_t>::max();
     constexpr auto kMaxHeadingLevel = 5;
-    enum class TokenType {
-        Text,
-        ParagraphBreak,
-
-        CtlSeq_BEGIN,
-        CtlSeqGeneric = CtlSeq_BEGIN,
-        CtlSeqInlineCode,
-        CtlSeqBold,
-        CtlSeqItalicAsterisk,
-        CtlSeqItalicUnderscore,
-        CtlSeqUnderline,
-        CtlSeqStrikethrough,
-        CtlSeq_END,
-    };
-
-    struct Token {
-        int64_t begin;
-        int64_t end;
-        // For some reason MSVC rejects this (referring to a local variable?)
-//        size_t pairedTokenIdx = kInvalidTokenIdx;
-        size_t pairedTokenIdx = std::numeric_limits<size_t>::max();
-        int headingLevel = 0;
-        TokenType type;
-        bool dead = false; //< Flag used to mark weather this control sequence token is allowed to have a match
-
-        bool IsText() const {
-            return type == TokenType::Text;
-        }
 
-        bool IsControlSequence() const {
-            auto n = (int)type;
-            return n >= (int)TokenType::CtlSeq_BEGIN && n < (int)TokenType::CtlSeq_END;
-        }
-
-        bool HasPairedToken() const { return pairedTokenIdx != kInvalidTokenIdx; }
-    };
-    std::vector<Token> tokens;
+    // Scratch buffers are only cleared, not freed, so that their capacity is reused by the next run
+    tokens.clear();
+    tokenPairingStack.clear();
 
     // The characters inside the parser's processing area (for size N, basically 1 current char + N-1 lookahead chars)
     constexpr int64_t kVisionSize = 3;
     ImWchar visionBuffer[kVisionSize] = {};
 
+#if IONL_DEBUG_FEATURES
+    bool useControlCharScan = !in.debugDisableControlCharScan;
+#else
+    constexpr bool useControlCharScan = true;
+#endif
+
     bool isEscaping = false;
     bool isBeginningOfLine = true;
+    bool isInsideCodeBlock = in.beginInsideCodeBlock;
     // == 0, regular text
     // > 0, heading
     int currHeadingLevel = 0;
 
     int64_t reader;
-    int readerAdvance = kVisionSize;
-    int readerAdvanceDone = 0; // Used inside loop, keeping track of number of advancements completed across segment changes
+    // Logical index of `reader`. The dummy segment at the end doesn't map to real buffer indices (it may run into the gap if the parsing range ends before it),
+    // so indices of chars in the vision buffer are calculated from this instead.
+    int64_t readerLogicalIdx;
+    int64_t readerAdvance = kVisionSize;
+    int64_t readerAdvanceDone = 0; // Used inside loop, keeping track of number of advancements completed across segment changes
 
     // TODO move all the stateful variable reads like `reader` `readerAdvance` into explicit parameters
+    auto calcVisionBufferBeginIdx = [&]() {
+        return MapLogicalIndexToBufferIndex(*in.src, readerLogicalIdx - kVisionSize);
+    };
     auto produceControlSequence = [&](TokenType tokenType) {
         if (isEscaping) {
             isEscaping = false;
             return;
         }
 
-        auto tokenBeginIdx = AdjustBufferIndex(*in.src, reader, -kVisionSize);
         tokens.push_back(Token{
-            .begin = tokenBeginIdx,
-            .end = tokenBeginIdx + readerAdvance,
-            .headingLevel = currHeadingLevel,
+            .begin = calcVisionBufferBeginIdx(),
+            .size = (uint8_t)readerAdvance,
+            .headingLevel = (uint8_t)currHeadingLevel,
             .type = tokenType,
         });
     };
 
+    int64_t rangeBegin = in.begin;
+    int64_t rangeEnd = in.end == -1 ? in.src->GetContentSize() : in.end;
+    auto [frontSegment, backSegment] = in.src->Segments(rangeBegin, rangeEnd);
+    // Buffer index of the first and one-past-last char to parse
+    // NOTE: like AdjustBufferIndex(), these map the logical index right at the gap to `GetGapEnd()`
+    int64_t rangeBeginIdx = MapLogicalIndexToBufferIndex(*in.src, rangeBegin);
+    int64_t rangeEndIdx = MapLogicalIndexToBufferIndex(*in.src, rangeEnd);
+    readerLogicalIdx = rangeBegin;
+
     std::pair<int64_t, int64_t> sourceSegments[] = {
-        { in.src->GetFrontBegin(), in.src->GetFrontSize() },
-        { in.src->GetBackBegin(), in.src->GetBackSize() },
-        // The dummy segment at the very end for `reader` to advance until the very end of source buffer
-        { in.src->GetBackEnd(), kVisionSize - 1 },
+        { frontSegment.data() - in.src->buffer, (int64_t)frontSegment.size() },
+        { backSegment.data() - in.src->buffer, (int64_t)backSegment.size() },
+        // The dummy segment at the very end for `reader` to advance until the very end of source range
+        { rangeEndIdx, kVisionSize - 1 },
     };
     for (auto it = std::begin(sourceSegments); it != std::end(sourceSegments); ++it) {
         const auto& sourceSegment = *it;
@@ -153,7 +165,7 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
         // It may instruct `reader` to be advanced by a certain number, depending on what it saw.
 
         // `reader` is index to the next char to be read into the vision buffer.
-        //  Use AdjustBufferIndex(buffer, reader, -kVisionSize) to get idx of the first char in the vision buffer.
+        //  Use calcVisionBufferBeginIdx() to get idx of the first char in the vision buffer.
 
         // `readerAdvance` is the number of characters the parser will advance, handled at the top.
         // `readerAdvance` and `readerAdvanceDone` are kept across segment changes to achieve the following logic:
@@ -167,6 +179,13 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
 
         reader = segmentBegin;
         while (true) {
+            // Skip over the chars that would be shifted out of the vision buffer without ever being looked at, without loading them
+            if (int64_t skip = std::min(readerAdvance - readerAdvanceDone - kVisionSize, segmentEnd - reader); skip > 0) {
+                reader += skip;
+                readerLogicalIdx += skip;
+                readerAdvanceDone += skip;
+            }
+
             // Advance `reader`
             for (; readerAdvanceDone < readerAdvance; ++readerAdvanceDone) {
                 if (reader >= segmentEnd) {
@@ -180,33 +199,55 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
                     visionBuffer[kVisionSize - 1] = '\0';
                 }
                 reader += 1;
+                readerLogicalIdx += 1;
             }
             readerAdvanceDone = 0;
 
             // Move ahead by 1 character by default, overridden by parser branches below
             readerAdvance = 1;
 
+            // Parse fenced code blocks
+            // Lines inside them are opaque, so skip directly to the end of line and let the \n be processed as usual
+            bool isCodeFence = visionBuffer[0] == '`' && visionBuffer[1] == '`' && visionBuffer[2] == '`';
+            if (isBeginningOfLine && visionBuffer[0] != '\n' && (isInsideCodeBlock || isCodeFence)) {
+                tokens.push_back({
+                    .begin = calcVisionBufferBeginIdx(),
+                    .size = 0,
+                    .type = isInsideCodeBlock && isCodeFence ? TokenType::CodeBlockClosingFence : TokenType::CodeBlockLine,
+                });
+                if (isCodeFence) {
+                    isInsideCodeBlock = !isInsideCodeBlock;
+                }
+
+                int64_t lineBegin = readerLogicalIdx - kVisionSize;
+                readerAdvance = FindNextOf<'\n'>(*in.src, lineBegin, rangeEnd) - lineBegin;
+                isBeginningOfLine = false;
+                isEscaping = false;
+                continue;
+            }
+
             // Parse heading
             if (isBeginningOfLine && visionBuffer[0] == '#') {
-                auto beginIdx = AdjustBufferIndex(*in.src, reader, -kVisionSize);
+                auto beginIdx = calcVisionBufferBeginIdx();
 
                 // We need quite a lot of lookahead here, so we use GapBufferIterator instead of having a super large vision buffer to avoid having to move around lots of data in the normal code path
                 GapBuffer::const_iterator iter(*in.src, beginIdx);
-                int headingLevel = 1;
-                while (*iter == '#' && iter.HasNext()) {
+                int headingLevel = 0;
+                while (iter.idx < rangeEndIdx && *iter == '#') {
                     headingLevel += 1;
                     ++iter;
                 }
 
-                if (*iter == ' ') {
-                    // Parsed heading sequence successfully
+                if (iter.idx < rangeEndIdx && *iter == ' ' && headingLevel <= kMaxHeadingLevel) {
+                    // Parsed heading sequence successfully, skip the #'s and the space
                     currHeadingLevel = headingLevel;
-                    readerAdvance = headingLevel;
+                    readerAdvance = headingLevel + 1;
 
                     continue;
                 } else {
-                    // Bad heading sequence, skip all the scanned parts as plain text
-                    readerAdvance = headingLevel + 1;
+                    // Bad heading sequence, skip all the scanned #'s as plain text
+                    // NOTE: the char after them must still go through the parser, it could be e.g. a \n
+                    readerAdvance = std::max(headingLevel, 1);
                 }
             }
 
@@ -254,11 +295,10 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
 
             // Set for next iteration
             if (visionBuffer[0] == '\n') {
-                auto beginIdx = AdjustBufferIndex(*in.src, reader, -kVisionSize);
                 tokens.push_back({
-                    .begin = beginIdx,
-                    .end = beginIdx + 1,
-                    .headingLevel = currHeadingLevel,
+                    .begin = calcVisionBufferBeginIdx(),
+                    .size = 1,
+                    .headingLevel = (uint8_t)currHeadingLevel,
                     .type = TokenType::ParagraphBreak,
                 });
 
@@ -267,6 +307,13 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
                 currHeadingLevel = 0;
             } else {
                 isBeginningOfLine = false;
+
+                // The current char is plain text (or a control char that didn't form anything), which leaves the parser in a state where every
+                // following plain text char is a no-op. Jump directly to the next char that could do anything.
+                if (readerAdvance == 1 && !isEscaping && useControlCharScan) {
+                    int64_t currLogicalIdx = readerLogicalIdx - kVisionSize;
+                    readerAdvance = FindNextControlChar(*in.src, currLogicalIdx + 1, rangeEnd) - currLogicalIdx;
+                }
             }
         }
 
@@ -274,55 +321,68 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
     }
 
     // Do token pairing
-    std::vector<size_t> tokenPairingStack;
-    for (size_t currIdx = 0; currIdx < tokens.size(); ++currIdx) {
+    // The stack holds at most one token of each type, so its position is tracked per type instead of scanning the stack
+    constexpr auto kNumCtlSeqTypes = (int)TokenType::CtlSeq_END - (int)TokenType::CtlSeq_BEGIN;
+    uint32_t stackPosOfType[kNumCtlSeqTypes];
+    std::fill(std::begin(stackPosOfType), std::end(stackPosOfType), kInvalidTokenIdx);
+    auto calcTypeSlot = [](TokenType type) { return (int)type - (int)TokenType::CtlSeq_BEGIN; };
+
+    for (uint32_t currIdx = 0; currIdx < tokens.size(); ++currIdx) {
         auto& curr = tokens[currIdx];
+        if (curr.type == TokenType::ParagraphBreak) {
+            // Control sequences never pair across paragraphs, this is what allows reparsing a single paragraph in isolation
+            tokenPairingStack.clear();
+            std::fill(std::begin(stackPosOfType), std::end(stackPosOfType), kInvalidTokenIdx);
+            continue;
+        }
         if (curr.IsControlSequence()) {
-            // Scan the stack for matching controls
-            // This is just a backwards iteration loop -- not using reverse iterator because converting them to indices for std::vector::resize is even more confusing than this
-            for (size_t candIdxIt = tokenPairingStack.size(); candIdxIt-- > 0;) {
-                size_t candIdx = tokenPairingStack[candIdxIt];
-                auto& cand = tokens[candIdx];
-
-                assert(candIdx != currIdx);
-
-                // Case: found
-                // - Discard all controls after this one, they are unmatched, e.g. **text__** gives a bold 'text__'
-                // - This leaves the pairedSymbolIndex field as undefined, which implies that it's not consumed
-                if (cand.type == curr.type) {
-                    cand.pairedTokenIdx = currIdx;
-                    curr.pairedTokenIdx = candIdx;
-
-                    if (cand.type == TokenType::CtlSeqInlineCode) {
-                        // Disable all other formatting control sequences inside inline code
-                        for (size_t i = candIdx + 1; i < currIdx; ++i) {
-                            auto& token = tokens[i];
-                            token.pairedTokenIdx = kInvalidTokenIdx;
-                        }
-                    }
-
-                    // Remove elements in vector including and after the `candIdxIdx`-th element
-                    tokenPairingStack.resize(candIdxIt);
-                    goto searchPairsDone;
-                }
-            }
+            auto& stackPos = stackPosOfType[calcTypeSlot(curr.type)];
 
             // Case: not found
             // - Push symbol into stack
-            tokenPairingStack.push_back(currIdx);
+            if (stackPos == kInvalidTokenIdx) {
+                stackPos = (uint32_t)tokenPairingStack.size();
+                tokenPairingStack.push_back(currIdx);
+                continue;
+            }
 
-        searchPairsDone:;
+            // Case: found
+            // - Discard all controls after this one, they are unmatched, e.g. **text__** gives a bold 'text__'
+            // - This leaves the pairedSymbolIndex field as undefined, which implies that it's not consumed
+            uint32_t candStackPos = stackPos;
+            uint32_t candIdx = tokenPairingStack[candStackPos];
+            auto& cand = tokens[candIdx];
+            assert(candIdx != currIdx);
+
+            cand.pairedTokenIdx = currIdx;
+            curr.pairedTokenIdx = candIdx;
+
+            if (cand.type == TokenType::CtlSeqInlineCode) {
+                // Disable all other formatting control sequences inside inline code
+                // NOTE: inline code spans never overlap, so this visits each token at most once
+                for (uint32_t i = candIdx + 1; i < currIdx; ++i) {
+                    auto& token = tokens[i];
+                    token.pairedTokenIdx = kInvalidTokenIdx;
+                }
+            }
+
+            // Remove elements in vector including and after the candidate
+            for (size_t i = candStackPos; i < tokenPairingStack.size(); ++i) {
+                stackPosOfType[calcTypeSlot(tokens[tokenPairingStack[i]].type)] = kInvalidTokenIdx;
+            }
+            tokenPairingStack.resize(candStackPos);
         }
     }
     // At this point everything left in `tokenPairingStack` is also unpaired
 
     // TODO if we inserted a ParagraphBreak at the very end, it could make TextRun generation much simpler
 
-    // Insert a single TextRun into `out.textRuns`, while handling breaking across the gap
-    auto outputTextRun = [&in, &out](TextRun run) {
+    // Insert a single TextRun into `out`, while handling breaking across the gap
+    auto outputTextRun = [&](TextRun run) {
         auto gapBegin = in.src->GetGapBegin();
         auto gapEnd = in.src->GetGapEnd();
-        if (run.begin < gapBegin && run.end > gapEnd) {
+        // NOTE: an end index of `gapEnd` means the run ends right at the gap, in which case the back part is empty
+        if (run.begin < gapBegin && run.end >= gapEnd) {
             // TextRun spans over the gap, we need to split it
             TextRun& frontRun = run;
             TextRun backRun = run;
@@ -332,15 +392,18 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
             backRun.begin = gapEnd;
             /* backRun.end; */ // Remain unchanged
 
-            out.textRuns.push_back(std::move(frontRun));
-            out.textRuns.push_back(std::move(backRun));
+            out.push_back(std::move(frontRun));
+            if (backRun.begin != backRun.end) {
+                out.push_back(std::move(backRun));
+            }
         } else {
-            out.textRuns.push_back(std::move(run));
+            out.push_back(std::move(run));
         }
     };
 
     TextStyle currStyle{};
-    int64_t currTextRunBegin = 0;
+    int64_t currTextRunBegin = rangeBeginIdx;
+    size_t outBegin = out.size();
 
     auto outputCurrTextRun = [&](int headingLevel, int64_t end) {
         if (currTextRunBegin == end) {
@@ -358,13 +421,28 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
     for (auto it = tokens.begin(); it != tokens.end(); ++it) {
         const auto& token = *it;
 
+        if (token.type == TokenType::CodeBlockLine || token.type == TokenType::CodeBlockClosingFence) {
+            // The line extends until the next token, which can only be the ParagraphBreak ending it
+            int64_t lineEnd = it + 1 != tokens.end() ? (it + 1)->begin : rangeEndIdx;
+            outputTextRun({
+                .begin = token.begin,
+                .end = lineEnd,
+                .style = {
+                    .type = token.type == TokenType::CodeBlockLine ? TextStyleType::CodeBlock : TextStyleType::CodeBlockClosingFence,
+                    .isMonospace = true,
+                },
+            });
+            currTextRunBegin = lineEnd;
+            continue;
+        }
+
         if (token.type == TokenType::ParagraphBreak) {
             outputCurrTextRun(token.headingLevel, token.begin);
-            currTextRunBegin = token.end; // We don't want the \n char to be a part of the text output
+            currTextRunBegin = AdjustBufferIndex(*in.src, token.begin, token.size); // We don't want the \n char to be a part of the text output
             currStyle = {};
 
-            if (!out.textRuns.empty()) {
-                out.textRuns.back().hasParagraphBreak = true;
+            if (out.size() > outBegin) {
+                out.back().hasParagraphBreak = true;
             }
 
             continue;
@@ -377,8 +455,10 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
                 currTextRunBegin = token.begin;
             } else {
                 // This is a closing control sequence
-                outputCurrTextRun(token.headingLevel, token.end);
-                currTextRunBegin = token.end;
+                // Control sequences may straddle the gap, so we can't just add to the begin index
+                int64_t tokenEnd = AdjustBufferIndex(*in.src, token.begin, token.size);
+                outputCurrTextRun(token.headingLevel, tokenEnd);
+                currTextRunBegin = tokenEnd;
             }
 
             switch (token.type) {
@@ -407,15 +487,19 @@ Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
         }
     }
     // Add the last text range if there is any left
-    if (auto lastTextEnd = in.src->GetLastTextEnd();
-        currTextRunBegin != lastTextEnd)
-    {
+    if (currTextRunBegin != rangeEndIdx) {
+        currStyle.type = MakeHeadingLevel(currHeadingLevel);
         outputTextRun({
             .begin = currTextRunBegin,
-            .end = lastTextEnd,
+            .end = rangeEndIdx,
             .style = currStyle,
         });
     }
+}
 
+Ionl::MdParseOutput Ionl::ParseMarkdownBuffer(const Ionl::MdParseInput& in) {
+    MdParseOutput out;
+    MdParser parser;
+    parser.Parse(in, out.textRuns);
     return out;
 }
@@ -2,13 +2,59 @@
 
 #include <imgui/imgui.h>
 #include <ionl/gap_buffer.hpp>
-#include <ionl/text_buffer.hpp>
 
 #include <cstdint>
+#include <limits>
 #include <vector>
 
 namespace Ionl {
 
+enum class TextStyleType {
+    Regular,
+    Url,
+    // Opening fence and body lines of a fenced code block
+    CodeBlock,
+    // Closing fence of a fenced code block
+    CodeBlockClosingFence,
+    Title_BEGIN,
+    Title1 = Title_BEGIN,
+    Title2,
+    Title3,
+    Title4,
+    Title5,
+    Title_END,
+};
+
+constexpr int kNumTitleLevels = (int)TextStyleType::Title_END - (int)TextStyleType::Title_BEGIN;
+
+// Heading level: number of #'s used in writing this heading
+// e.g. # Heading -> 1
+//      ## Heading -> 2
+int CalcHeadingLevel(TextStyleType type);
+TextStyleType MakeHeadingLevel(int level);
+bool IsHeading(TextStyleType type);
+
+struct TextStyle {
+    TextStyleType type;
+
+    // Face variants
+    bool isMonospace = false;
+    bool isBold = false;
+    bool isItalic = false;
+    // Decorations
+    bool isUnderline = false;
+    bool isStrikethrough = false;
+
+    bool operator==(const TextStyle&) const = default;
+};
+
+struct TextRun {
+    int64_t begin = 0; // Buffer index
+    int64_t end = 0; // Buffer index
+    TextStyle style = {};
+    bool hasParagraphBreak = false; // Whether to break paragraph at end of this TextRun
+};
+
 struct MarkdownFace {
     // [Required]
     ImFont* font = nullptr;
@@ -37,10 +83,78 @@ extern MarkdownStylesheet gMarkdownStylesheet;
 struct MdParseInput {
     // [Required] Source buffer to parse markdown from.
     const GapBuffer* src;
+    // [Optional] Logical range [begin, end) of `src` to parse; end == -1 means until the end of the buffer.
+    // Both ends must lie on paragraph boundaries (i.e. right after a \n, or the ends of the buffer), because parsing state is reset on every paragraph break.
+    int64_t begin = 0;
+    int64_t end = -1;
+    // [Optional] Whether `begin` is inside a fenced code block, i.e. the paragraphs before it opened one without closing it.
+    // See IsInsideCodeBlockAfter().
+    bool beginInsideCodeBlock = false;
+#if IONL_DEBUG_FEATURES
+    // [Optional] Walk over every char with the parser state machine instead of skipping plain text, for checking the scan against in tests.
+    bool debugDisableControlCharScan = false;
+#endif
 };
+// Whether the paragraph ending with `lastTextRun` leaves an unclosed fenced code block
+inline bool IsInsideCodeBlockAfter(const TextRun& lastTextRun) {
+    return lastTextRun.style.type == TextStyleType::CodeBlock;
+}
+
 struct MdParseOutput {
     std::vector<TextRun> textRuns;
 };
+
+// Markdown parsing context, which keeps its scratch buffers between runs so that parsing doesn't allocate in steady state.
+struct MdParser {
+    enum class TokenType : uint8_t {
+        Text,
+        ParagraphBreak,
+        // A whole line inside a fenced code block (including the fences), which extends until the next ParagraphBreak or end of range
+        CodeBlockLine,
+        CodeBlockClosingFence,
+
+        CtlSeq_BEGIN,
+        CtlSeqGeneric = CtlSeq_BEGIN,
+        CtlSeqInlineCode,
+        CtlSeqBold,
+        CtlSeqItalicAsterisk,
+        CtlSeqItalicUnderscore,
+        CtlSeqUnderline,
+        CtlSeqStrikethrough,
+        CtlSeq_END,
+    };
+
+    static constexpr uint32_t kInvalidTokenIdx = std::numeric_limits<uint32_t>::max();
+
+    struct Token {
+        int64_t begin; // Buffer index
+        uint32_t pairedTokenIdx = kInvalidTokenIdx;
+        // Number of chars in this token; it may straddle the gap, so use AdjustBufferIndex() to get the end index
+        uint8_t size;
+        uint8_t headingLevel = 0;
+        TokenType type;
+
+        bool IsText() const {
+            return type == TokenType::Text;
+        }
+
+        bool IsControlSequence() const {
+            auto n = (int)type;
+            return n >= (int)TokenType::CtlSeq_BEGIN && n < (int)TokenType::CtlSeq_END;
+        }
+
+        bool HasPairedToken() const { return pairedTokenIdx != kInvalidTokenIdx; }
+    };
+    static_assert(sizeof(Token) == 16);
+
+    std::vector<Token> tokens;
+    std::vector<uint32_t> tokenPairingStack;
+
+    // Parse `in` and append the generated TextRun's to `out`.
+    void Parse(const MdParseInput& in, std::vector<TextRun>& out);
+};
+
+// Convenience wrapper for one-off parsing with a temporary MdParser.
 MdParseOutput ParseMarkdownBuffer(const MdParseInput& in);
 
 } // namespace Ionl
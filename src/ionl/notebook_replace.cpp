@@ -0,0 +1,234 @@
+#include "notebook_replace.hpp"
+
+#include <ionl/text_buffer.hpp>
+#include <ionl/utf8.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+using namespace Ionl;
+
+// Rows are handed to the workers once a batch holds about this much text, so that many small bullets don't become one task each
+constexpr size_t kBatchTextSize = 1024 * 1024;
+
+struct ReplaceBatch {
+    std::vector<Pbid> pbids;
+    // Original content going in; replaced content coming out, or empty if nothing matched
+    std::vector<std::string> texts;
+    std::vector<int32_t> numReplacements;
+    size_t totalTextSize = 0;
+};
+
+// Apply FoldCase() to the UTF-8 text in place. Every char it maps is either ASCII or a 2-byte sequence whose folded counterpart is 2 bytes as
+// well, so byte offsets into the folded text are valid in the original text.
+void FoldCaseUtf8(std::string& text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto b0 = (unsigned char)text[i];
+        if (b0 < 0x80) {
+            text[i] = (char)FoldCase(b0);
+        } else if (b0 >= 0xC2 && b0 <= 0xDF && i + 1 < text.size() && ((unsigned char)text[i + 1] & 0xC0) == 0x80) {
+            auto b1 = (unsigned char)text[i + 1];
+            auto c = (ImWchar)(((b0 & 0x1F) << 6) | (b1 & 0x3F));
+            auto folded = FoldCase(c);
+            text[i] = (char)(0xC0 | (folded >> 6));
+            text[i + 1] = (char)(0x80 | (folded & 0x3F));
+            i += 1;
+        }
+        // Lead bytes of longer sequences and stray continuation bytes are left alone, and can never be mistaken for a 2-byte lead byte
+    }
+}
+
+// Replace all occurrences of `needle` in `haystack` (which is either `text` itself or a case folded copy of it) with `replacement`, building
+// the result from `text`. Returns the number of replacements made; `out` is only written if that is not 0.
+int32_t ReplaceAll(std::string_view text, std::string_view haystack, std::string_view needle, std::string_view replacement, std::string& out) {
+    int32_t count = 0;
+    size_t last = 0;
+    while (true) {
+        size_t idx = haystack.find(needle, last);
+        if (idx == std::string_view::npos) {
+            break;
+        }
+        if (count == 0) {
+            out.clear();
+            out.reserve(text.size());
+        }
+        out.append(text.substr(last, idx - last));
+        out.append(replacement);
+        last = idx + needle.size();
+        count += 1;
+    }
+    if (count > 0) {
+        out.append(text.substr(last));
+    }
+    return count;
+}
+
+void ProcessBatch(ReplaceBatch& batch, std::string_view needle, std::string_view replacement, bool caseInsensitive) {
+    std::string folded;
+    std::string result;
+    for (size_t i = 0; i < batch.texts.size(); ++i) {
+        auto& text = batch.texts[i];
+        std::string_view haystack = text;
+        if (caseInsensitive) {
+            folded = text;
+            FoldCaseUtf8(folded);
+            haystack = folded;
+        }
+
+        int32_t count = ReplaceAll(text, haystack, needle, replacement, result);
+        batch.numReplacements[i] = count;
+        // Drop unchanged content right away, there is nothing to write back
+        text = count > 0 ? std::move(result) : std::string();
+        result = std::string();
+    }
+}
+
+std::vector<ImWchar> DecodeUtf8(std::string_view text) {
+    std::vector<ImWchar> result(CountUtf8ToImWchar(text.data(), text.data() + text.size()));
+    TranscodeUtf8ToImWchar(text.data(), text.data() + text.size(), result.data());
+    return result;
+}
+
+// Replace all matches of `searcher` in a loaded TextBuffer with one TextBuffer::ApplyEdits(), so that the replacement is a single undo step.
+// Returns the number of replacements made.
+int32_t ReplaceAllInTextBuffer(TextBuffer& tb, const TextSearcher& searcher, std::span<const ImWchar> replacement) {
+    std::vector<TextSearchMatch> matches;
+    searcher.FindAll(tb.gapBuffer, 0, tb.gapBuffer.GetContentSize(), matches);
+
+    if (matches.empty()) {
+        return 0;
+    }
+
+    std::vector<GapBufferEdit> edits;
+    edits.reserve(matches.size());
+    for (auto& match : matches) {
+        edits.push_back({ .idx = match.begin, .removedSize = match.end - match.begin, .text = replacement });
+    }
+    [[maybe_unused]] bool applied = tb.ApplyEdits(edits);
+    // Matches are sorted and non-overlapping
+    assert(applied);
+    tb.RefreshCaches();
+    return (int32_t)matches.size();
+}
+} // namespace
+
+Ionl::NotebookReplaceResult Ionl::ReplaceInNotebook(Document& document, SQLiteBackingStore& store, WorkerPool& pool, std::string_view find, std::string_view replacement, TextSearchOptions options) {
+    NotebookReplaceResult result;
+    if (find.empty()) {
+        return result;
+    }
+
+    std::string needle(find);
+    if (options.caseInsensitive) {
+        FoldCaseUtf8(needle);
+    }
+    bool caseInsensitive = options.caseInsensitive;
+
+    std::vector<std::unique_ptr<ReplaceBatch>> batches;
+    std::atomic<int> numPendingBatches = 0;
+    auto submitBatch = [&]() {
+        auto batch = batches.back().get();
+        batch->numReplacements.resize(batch->texts.size());
+        numPendingBatches.fetch_add(1, std::memory_order_relaxed);
+        // The tasks only reference locals of this function, which waits for all of them before returning
+        pool.Submit([&, batch]() {
+            ProcessBatch(*batch, needle, replacement, caseInsensitive);
+
+            numPendingBatches.fetch_sub(1, std::memory_order_release);
+            numPendingBatches.notify_all();
+        });
+    };
+
+    // Let SQLite rule out rows for case-sensitive searches; there is no prefilter matching FoldCase(), so all rows are searched otherwise
+    auto prefilter = caseInsensitive ? std::string_view() : find;
+    // Bullets with a loaded TextBuffer are replaced in that instead, their rows are the same as its content
+    std::vector<Bullet*> loadedBullets;
+    store.ForEachTextualBullet(prefilter, [&](Pbid pbid, std::string_view content) {
+        result.numBulletsScanned += 1;
+        if (auto bullet = document.GetBulletByPbid(pbid)) {
+            if (auto bc = std::get_if<BulletContentTextual>(&bullet->content.v); bc && bc->textBuffer) {
+                loadedBullets.push_back(bullet);
+                return;
+            }
+        }
+
+        if (batches.empty() || batches.back()->totalTextSize >= kBatchTextSize) {
+            if (!batches.empty()) {
+                submitBatch();
+            }
+            batches.push_back(std::make_unique<ReplaceBatch>());
+        }
+        auto& batch = *batches.back();
+        batch.pbids.push_back(pbid);
+        batch.texts.push_back(std::string(content));
+        batch.totalTextSize += content.size();
+    });
+    if (!batches.empty()) {
+        submitBatch();
+    }
+
+    // Meanwhile on this thread, the loaded bullets are replaced like TextSearcher matches them, and the text to write is taken from the result
+    std::vector<Bullet*> changedLoadedBullets;
+    if (!loadedBullets.empty()) {
+        TextSearcher searcher(DecodeUtf8(find), options);
+        auto replacementChars = DecodeUtf8(replacement);
+        for (auto bullet : loadedBullets) {
+            auto& bc = std::get<BulletContentTextual>(bullet->content.v);
+            // Through the Document, which keeps track of the TextBuffer's that are expanded
+            auto& tb = document.FetchTextBuffer(bc);
+            int32_t count = ReplaceAllInTextBuffer(tb, searcher, replacementChars);
+            if (count == 0) {
+                continue;
+            }
+
+            bc.text = tb.gapBuffer.ExtractContent();
+            changedLoadedBullets.push_back(bullet);
+            result.numBulletsChanged += 1;
+            result.numReplacements += count;
+        }
+    }
+
+    int numPending;
+    while ((numPending = numPendingBatches.load(std::memory_order_acquire)) != 0) {
+        numPendingBatches.wait(numPending, std::memory_order_acquire);
+    }
+
+    // One transaction for all rows, instead of one implicit transaction (and journal sync) per row
+    store.BeginTransaction();
+    for (auto bullet : changedLoadedBullets) {
+        store.SetBulletContent(bullet->pbid, bullet->content);
+    }
+    BulletContent content;
+    for (auto& batch : batches) {
+        for (size_t i = 0; i < batch->pbids.size(); ++i) {
+            if (batch->numReplacements[i] == 0) {
+                continue;
+            }
+
+            auto pbid = batch->pbids[i];
+            content.v = BulletContentTextual{ .text = std::move(batch->texts[i]) };
+            store.SetBulletContent(pbid, content);
+            result.numBulletsChanged += 1;
+            result.numReplacements += batch->numReplacements[i];
+
+            // Loaded bullets without a TextBuffer still hold a copy of the row
+            if (auto bullet = document.GetBulletByPbid(pbid)) {
+                if (auto bc = std::get_if<BulletContentTextual>(&bullet->content.v)) {
+                    bc->text = std::move(std::get<BulletContentTextual>(content.v).text);
+                }
+            }
+        }
+        // Free each batch as soon as it is written
+        batch.reset();
+    }
+    store.CommitTransaction();
+
+    return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <ionl/backing_store.hpp>
+#include <ionl/document.hpp>
+#include <ionl/text_search.hpp>
+#include <ionl/worker_pool.hpp>
+
+#include <cstdint>
+#include <string_view>
+
+namespace Ionl {
+
+struct NotebookReplaceResult {
+    int64_t numBulletsScanned = 0;
+    int64_t numBulletsChanged = 0;
+    int64_t numReplacements = 0;
+};
+
+// Replace every occurrence of `find` in all textual bullets of `store`, rewriting rows on `pool` and loaded TextBuffer's of `document`.
+// NOTE: call Document::SaveStaleTexts() and flush any WriteDelayedBackingStore in front of `store` first, or the rows read here are stale
+NotebookReplaceResult ReplaceInNotebook(Document& document, SQLiteBackingStore& store, WorkerPool& pool, std::string_view find, std::string_view replacement, TextSearchOptions options = {});
+
+} // namespace Ionl
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <bit>
+#include <cstdint>
+
+// Compile time detection of the available SIMD instruction sets.
+// Code using these should always provide a scalar fallback, for when neither is available (e.g. on ARM).
+//
+// NOTE: MSVC doesn't define __SSE2__, but SSE2 is always available on x64; it defines __AVX2__ only when /arch:AVX2 is given.
+#if defined(__AVX2__)
+#	define IONL_SIMD_AVX2 1
+#else
+#	define IONL_SIMD_AVX2 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define IONL_SIMD_SSE2 1
+#else
+#	define IONL_SIMD_SSE2 0
+#endif
+
+#if IONL_SIMD_AVX2
+#	include <immintrin.h>
+#elif IONL_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace Ionl {
+
+// Vectorized code over ImWchar's works on 16-bit lanes, which is the default ImWchar; with IMGUI_USE_WCHAR32 only the scalar fallbacks are used
+constexpr bool kCanVectorizeImWchar = sizeof(ImWchar) == 2;
+
+// Helpers for _mm_movemask_epi8() and _mm256_movemask_epi8() results of 16-bit lane comparisons, which have 2 bits set per matching lane
+inline int FirstLane16(uint32_t mask) {
+    return std::countr_zero(mask) / 2;
+}
+inline int CountLanes16(uint32_t mask) {
+    return std::popcount(mask) / 2;
+}
+inline uint32_t ClearFirstLane16(uint32_t mask) {
+    mask &= mask - 1;
+    return mask & (mask - 1);
+}
+
+} // namespace Ionl
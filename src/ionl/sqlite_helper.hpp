@@ -159,6 +159,10 @@ struct SQLiteRunningStatement {
             return (T)sqlite3_column_int64(stmt, column);
         } else if constexpr (std::is_same_v<T, const char*>) {
             return (const char*)sqlite3_column_text(stmt, column);
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            // NOTE: only valid until the next Step(); sqlite3_column_bytes() must be called after sqlite3_column_text(), which may convert the value
+            auto cstr = (const char*)sqlite3_column_text(stmt, column);
+            return std::string_view(cstr ? cstr : "", (size_t)sqlite3_column_bytes(stmt, column));
         } else if constexpr (std::is_same_v<T, std::string>) {
             auto cstr = (const char*)sqlite3_column_text(stmt, column);
             return std::string(cstr);
@@ -1,36 +1,447 @@
 #include "text_buffer.hpp"
 
-int Ionl::CalcHeadingLevel(TextStyleType type) {
-    auto n = static_cast<int>(type);
-    return n - static_cast<int>(TextStyleType::Title_BEGIN) + 1;
+#include <ionl/markdown.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <utility>
+
+Ionl::TextBuffer::TextBuffer(GapBuffer buf, bool refreshCaches)
+    : gapBuffer{ std::move(buf) } //
+{
+    if (refreshCaches) {
+        RefreshCaches();
+    }
+}
+
+namespace {
+using namespace Ionl;
+
+// Copy out the current content in [begin, end)
+std::vector<ImWchar> ReadContent(const TextBuffer& tb, int64_t begin, int64_t end) {
+    std::vector<ImWchar> result;
+    result.reserve(end - begin);
+    tb.gapBuffer.ForEachSegment(begin, end, [&](std::span<const ImWchar> segment) {
+        result.insert(result.end(), segment.begin(), segment.end());
+    });
+    return result;
+}
+
+// Replace without recording into `TextBuffer::history`. Costs at most a single gap move in the gap buffer, see EraseRange().
+void ReplaceContent(TextBuffer& tb, int64_t idx, int64_t removedSize, const ImWchar* text, size_t size) {
+    // The inserted text goes into the same gap that absorbed the removed range
+    EraseRange(tb.gapBuffer, idx, idx + removedSize);
+    if (size > 0) {
+        InsertAtGap(tb.gapBuffer, text, size);
+    }
+    tb.MarkEdited(idx, removedSize, (int64_t)size);
+}
+
+// Apply the inverse of `record` to the content, and turn `record` into the inverse of that for the opposite stack of `TextBuffer::history`.
+// Returns the logical index right after the text put back.
+int64_t RevertRecord(TextBuffer& tb, EditRecord& record) {
+    tb.Expand();
+    auto insertedText = ReadContent(tb, record.idx, record.idx + record.insertedSize);
+    ReplaceContent(tb, record.idx, record.insertedSize, record.removedText.data(), record.removedText.size());
+    record.insertedSize = (int64_t)record.removedText.size();
+    record.removedText = std::move(insertedText);
+    return record.idx + record.insertedSize;
 }
 
-Ionl::TextStyleType Ionl::MakeHeadingLevel(int level) {
-    if (level == 0) {
-        return TextStyleType::Regular;
+// Paragraphs are lines, so both of these are lookups in `GapBuffer::lineIndex` instead of scans over possibly very long paragraphs
+int64_t FindParagraphBegin(const GapBuffer& buf, int64_t logicalIdx) {
+    return MapLineToLogicalIndex(buf, MapLogicalIndexToLine(buf, logicalIdx));
+}
+
+// Returns index to the char after the \n ending the paragraph, or end of the buffer if this is the last paragraph.
+int64_t FindParagraphEnd(const GapBuffer& buf, int64_t logicalIdx) {
+    int64_t idx = MapLineToLogicalIndex(buf, MapLogicalIndexToLine(buf, logicalIdx) + 1);
+    return idx == -1 ? buf.GetContentSize() : idx;
+}
+
+// Push a TextRun described in logical indices into `out`, converting to buffer indices and splitting it across the gap if necessary.
+void PushLogicalTextRun(std::vector<TextRun>& out, const GapBuffer& buf, TextRun run) {
+    int64_t frontSize = buf.GetFrontSize();
+    int64_t gapSize = buf.GetGapSize();
+    if (run.begin >= frontSize) {
+        run.begin += gapSize;
+        run.end += gapSize;
+        out.push_back(std::move(run));
+    } else if (run.end <= frontSize) {
+        out.push_back(std::move(run));
     } else {
-        return static_cast<TextStyleType>(static_cast<int>(TextStyleType::Title_BEGIN) + level - 1);
+        TextRun backRun = run;
+        run.end = frontSize;
+        run.hasParagraphBreak = false;
+        backRun.begin = frontSize + gapSize;
+        backRun.end += gapSize;
+        out.push_back(std::move(run));
+        out.push_back(std::move(backRun));
     }
 }
+} // namespace
+
+void Ionl::TextBuffer::Compact() {
+    if (isCompacted) {
+        return;
+    }
+
+    compactContent = gapBuffer.ExtractContent();
+    isCompacted = true;
 
-bool Ionl::IsHeading(TextStyleType type) {
-    auto n = static_cast<int>(type);
-    return n >= static_cast<int>(TextStyleType::Title_BEGIN) &&
-        n < static_cast<int>(TextStyleType::Title_END);
+    FreeMemory(gapBuffer);
+    FreeMemory(parser);
+    FreeMemory(textRuns);
+    FreeMemory(textRunsScratch);
+    textRunsChange = {};
+    cachedFrontSize = 0;
+    cachedGapSize = 0;
+    hasDirtyRange = false;
+    // Invalidate anything derived from the previous content, e.g. TextEdit layouts and pending TextBufferBatchParser results
+    cacheDataVersion += 1;
 }
 
-Ionl::TextBuffer::TextBuffer(GapBuffer buf)
-    : gapBuffer{ std::move(buf) } //
-{
+void Ionl::TextBuffer::Expand() {
+    if (!isCompacted) {
+        return;
+    }
+
+    gapBuffer = GapBuffer(compactContent);
+    FreeMemory(compactContent);
+    isCompacted = false;
+
+    // No edits are recorded, so this is a full parse
     RefreshCaches();
 }
 
+void Ionl::TextBuffer::ShrinkToFit() {
+    // TextRun's can only be remapped if they were generated from the content as it is now, with the gap where it is now
+    bool isCacheCurrent = !isCompacted &&
+        cacheDataVersion != 0 &&
+        !hasDirtyRange &&
+        gapBuffer.GetFrontSize() == cachedFrontSize &&
+        gapBuffer.GetGapSize() == cachedGapSize;
+    if (!isCacheCurrent) {
+        return;
+    }
+
+    int64_t oldGapSize = gapBuffer.GetGapSize();
+    Ionl::ShrinkToFit(gapBuffer, kShrunkGapSize);
+    int64_t delta = gapBuffer.GetGapSize() - oldGapSize;
+    if (delta == 0) {
+        return;
+    }
+
+    for (auto& run : textRuns) {
+        if (run.begin >= cachedFrontSize) {
+            run.begin += delta;
+            run.end += delta;
+        }
+    }
+
+    // Nothing was reparsed, only the gap changed
+    textRunsChange = {
+        .isFull = false,
+        .prevFrontSize = cachedFrontSize,
+        .prevGapSize = cachedGapSize,
+    };
+    cachedGapSize = gapBuffer.GetGapSize();
+    cacheDataVersion += 1;
+}
+
+void Ionl::TextBuffer::ShrinkToFitIfIdle(std::chrono::steady_clock::duration idleTime) {
+    if (gapBuffer.GetGapSize() <= kShrunkGapSize) {
+        return;
+    }
+    if (std::chrono::steady_clock::now() - lastEditTime < idleTime) {
+        return;
+    }
+    ShrinkToFit();
+}
+
+Ionl::GapBufferSnapshot Ionl::TextBuffer::TakeSnapshot() {
+    if (isCompacted) {
+        GapBuffer content(compactContent);
+        return GapBufferSnapshot(content);
+    }
+
+    return GapBufferSnapshot(gapBuffer);
+}
+
+void Ionl::TextBuffer::Insert(int64_t idx, const ImWchar* text, size_t size) {
+    Replace(idx, 0, text, size);
+}
+
+void Ionl::TextBuffer::Erase(int64_t idx, int64_t size) {
+    Replace(idx, size, nullptr, 0);
+}
+
+void Ionl::TextBuffer::Replace(int64_t idx, int64_t removedSize, const ImWchar* text, size_t size) {
+    Expand();
+    // Removed text is copied out eagerly, which costs O(removedSize) but is bounded by the history memory limit. Recording it lazily wouldn't
+    // save anything: the next insert at `idx` overwrites the gap that still holds it, so it would have to be copied out then anyway.
+    if (history.CanRecord(removedSize)) {
+        auto removedText = ReadContent(*this, idx, idx + removedSize);
+        history.Record(idx, removedText, std::span<const ImWchar>(text, size));
+    } else {
+        // Too large to ever be undone, and the steps before it can't be undone without undoing it first; don't bother copying it out
+        history.Clear();
+    }
+    ReplaceContent(*this, idx, removedSize, text, size);
+}
+
+bool Ionl::TextBuffer::ApplyEdits(std::span<const GapBufferEdit> edits) {
+    if (edits.empty()) {
+        return true;
+    }
+
+    Expand();
+
+    int64_t begin = std::numeric_limits<int64_t>::max();
+    int64_t oldEnd = 0;
+    int64_t delta = 0;
+    for (auto& edit : edits) {
+        begin = std::min(begin, edit.idx);
+        oldEnd = std::max(oldEnd, edit.idx + edit.removedSize);
+        delta += (int64_t)edit.text.size() - edit.removedSize;
+    }
+    int64_t newEnd = oldEnd + delta;
+    // Checked in full by Ionl::ApplyEdits(), this only keeps the removed range readable
+    if (begin < 0 || oldEnd < begin || oldEnd > gapBuffer.GetContentSize()) {
+        return false;
+    }
+
+    if (history.CanRecord(oldEnd - begin)) {
+        auto removedText = ReadContent(*this, begin, oldEnd);
+        if (!Ionl::ApplyEdits(gapBuffer, edits)) {
+            return false;
+        }
+
+        // The gap is right after the last edit, so the new text is all in the front
+        history.Seal();
+        history.Record(begin, removedText, gapBuffer.Segments(begin, newEnd)[0]);
+    } else {
+        if (!Ionl::ApplyEdits(gapBuffer, edits)) {
+            return false;
+        }
+        history.Clear();
+    }
+    MarkEdited(begin, oldEnd - begin, newEnd - begin);
+    return true;
+}
+
+int64_t Ionl::TextBuffer::Paste(int64_t idx, int64_t removedSize, std::string_view text) {
+    Expand();
+
+    std::vector<ImWchar> removedText;
+    bool canRecord = history.CanRecord(removedSize);
+    if (canRecord) {
+        removedText = ReadContent(*this, idx, idx + removedSize);
+    }
+
+    EraseRange(gapBuffer, idx, idx + removedSize);
+    InsertNormalizedAtGap(gapBuffer, text.data(), text.size());
+    // The gap is right after the pasted text, so it is all in the front
+    int64_t insertedSize = gapBuffer.GetFrontSize() - idx;
+
+    if (canRecord) {
+        history.Seal();
+        history.Record(idx, removedText, gapBuffer.Segments(idx, idx + insertedSize)[0]);
+    } else {
+        history.Clear();
+    }
+    MarkEdited(idx, removedSize, insertedSize);
+    return insertedSize;
+}
+
+int64_t Ionl::TextBuffer::Undo() {
+    auto record = history.TakeUndo();
+    if (!record) {
+        return -1;
+    }
+    int64_t result = RevertRecord(*this, *record);
+    history.PushRedo(std::move(*record));
+    return result;
+}
+
+int64_t Ionl::TextBuffer::Redo() {
+    auto record = history.TakeRedo();
+    if (!record) {
+        return -1;
+    }
+    int64_t result = RevertRecord(*this, *record);
+    history.PushUndo(std::move(*record));
+    return result;
+}
+
+void Ionl::TextBuffer::MarkEdited(int64_t idx, int64_t removedSize, int64_t insertedSize) {
+    lastEditTime = std::chrono::steady_clock::now();
+
+    if (!hasDirtyRange) {
+        dirtyBegin = idx;
+        dirtyEnd = idx + insertedSize;
+        dirtyDelta = insertedSize - removedSize;
+        hasDirtyRange = true;
+        return;
+    }
+
+    // Bring the existing range's end into the current content: anything after the removed text is shifted,
+    // and anything inside it is collapsed onto the inserted text below
+    int64_t end = dirtyEnd;
+    if (end >= idx + removedSize) {
+        end += insertedSize - removedSize;
+    }
+
+    dirtyBegin = std::min(dirtyBegin, idx);
+    dirtyEnd = std::max(end, idx + insertedSize);
+    dirtyDelta += insertedSize - removedSize;
+}
+
 void Ionl::TextBuffer::RefreshCaches() {
-    auto res = ParseMarkdownBuffer({
-        .src = &gapBuffer,
-    });
+    if (isCompacted) {
+        Expand();
+        return;
+    }
+
+    // Version 0 means cached data was never generated (see the constructor), so there is nothing to update incrementally
+    if (!hasDirtyRange || cacheDataVersion == 0) {
+        textRuns.clear();
+        parser.Parse({ .src = &gapBuffer }, textRuns);
+        textRunsChange = {};
+        matchIndex.Rebuild(gapBuffer);
+    } else {
+        // Paragraph breaks reset all parsing state, so it suffices to reparse the paragraphs touching the edited range
+        int64_t contentSize = gapBuffer.GetContentSize();
+        ReparsedRange editedRange;
+        editedRange.newBegin = FindParagraphBegin(gapBuffer, std::clamp<int64_t>(dirtyBegin, 0, contentSize));
+        editedRange.newEnd = FindParagraphEnd(gapBuffer, std::clamp<int64_t>(dirtyEnd, 0, contentSize));
+        editedRange.oldBegin = editedRange.newBegin;
+        editedRange.oldEnd = editedRange.newEnd - dirtyDelta;
+        // Search matches depend on the content only, unlike TextRun's they don't need the ranges below
+        matchIndex.OnEdited(gapBuffer, editedRange.newBegin, editedRange.oldEnd, editedRange.newEnd);
+
+        // The previous gap location splits TextRun's in its paragraph, where the parser wouldn't otherwise;
+        // reparse that paragraph too so that the TextRun's are exactly the same as if everything was reparsed
+        ReparsedRange gapRange;
+        bool hasGapRange = false;
+        int64_t prevGap = cachedFrontSize;
+        if (prevGap < editedRange.oldBegin || prevGap > editedRange.oldEnd) {
+            int64_t delta = prevGap < editedRange.oldBegin ? 0 : dirtyDelta;
+            int64_t gap = prevGap + delta;
+            if (gap > 0 && gap < contentSize && gapBuffer[gap - 1] != '\n') {
+                gapRange.newBegin = FindParagraphBegin(gapBuffer, gap);
+                gapRange.newEnd = FindParagraphEnd(gapBuffer, gap);
+                gapRange.oldBegin = gapRange.newBegin - delta;
+                gapRange.oldEnd = gapRange.newEnd - delta;
+                hasGapRange = true;
+            }
+        }
+
+        textRunsChange = {
+            .isFull = false,
+            .prevFrontSize = cachedFrontSize,
+            .prevGapSize = cachedGapSize,
+        };
+        if (hasGapRange && gapRange.oldEnd <= editedRange.oldBegin) {
+            textRunsChange.ranges[textRunsChange.numRanges++] = gapRange;
+        }
+        textRunsChange.ranges[textRunsChange.numRanges++] = editedRange;
+        if (hasGapRange && gapRange.oldBegin >= editedRange.oldEnd) {
+            textRunsChange.ranges[textRunsChange.numRanges++] = gapRange;
+        }
+
+        auto mapOldIndex = [&](int64_t bufferIdx) {
+            return bufferIdx < cachedFrontSize ? bufferIdx : bufferIdx - cachedGapSize;
+        };
+
+        // Splice the new TextRun's in place of the reparsed ranges, remapping the others from the old gap location to the new one
+        auto& newTextRuns = textRunsScratch;
+        newTextRuns.clear();
+
+        auto oldIt = textRuns.begin();
+        int64_t delta = 0;
+        auto pushUnchangedUntil = [&](int64_t oldLogicalIdx) {
+            for (; oldIt != textRuns.end(); ++oldIt) {
+                int64_t begin = mapOldIndex(oldIt->begin);
+                if (begin >= oldLogicalIdx) {
+                    break;
+                }
+                TextRun run = *oldIt;
+                run.begin = begin + delta;
+                run.end = begin + delta + (oldIt->end - oldIt->begin);
+                PushLogicalTextRun(newTextRuns, gapBuffer, std::move(run));
+            }
+        };
+        auto isInsideCodeBlockAfter = [](const std::vector<TextRun>& runs, std::vector<TextRun>::const_iterator end) {
+            return end != runs.begin() && IsInsideCodeBlockAfter(*std::prev(end));
+        };
+        for (int i = 0; i < textRunsChange.numRanges; ++i) {
+            auto& range = textRunsChange.ranges[i];
 
-    textRuns = std::move(res.textRuns);
+            pushUnchangedUntil(range.oldBegin);
+            while (oldIt != textRuns.end() && mapOldIndex(oldIt->begin) < range.oldEnd) {
+                ++oldIt;
+            }
+
+            parser.Parse(
+                {
+                    .src = &gapBuffer,
+                    .begin = range.newBegin,
+                    .end = range.newEnd,
+                    .beginInsideCodeBlock = isInsideCodeBlockAfter(newTextRuns, newTextRuns.end()),
+                },
+                newTextRuns);
+
+            // If the edit opened or closed a code fence, every paragraph after it may be parsed differently; reparse until the end of content
+            bool isInsideCodeBlock = isInsideCodeBlockAfter(newTextRuns, newTextRuns.end());
+            if (isInsideCodeBlock != isInsideCodeBlockAfter(textRuns, oldIt)) {
+                parser.Parse(
+                    {
+                        .src = &gapBuffer,
+                        .begin = range.newEnd,
+                        .beginInsideCodeBlock = isInsideCodeBlock,
+                    },
+                    newTextRuns);
+
+                oldIt = textRuns.end();
+                range.oldEnd += contentSize - range.newEnd;
+                range.newEnd = contentSize;
+                // The following ranges are covered by this one now
+                textRunsChange.numRanges = i + 1;
+                break;
+            }
+
+            delta = range.newEnd - range.oldEnd;
+        }
+        pushUnchangedUntil(std::numeric_limits<int64_t>::max());
+
+        // Keep the old array as the scratch for next time
+        std::swap(textRuns, textRunsScratch);
+    }
+
+    cachedFrontSize = gapBuffer.GetFrontSize();
+    cachedGapSize = gapBuffer.GetGapSize();
+    hasDirtyRange = false;
     cacheDataVersion += 1;
 }
 
+void Ionl::TextBuffer::SetSearch(TextSearcher searcher) {
+    matchIndex.Reset(std::move(searcher));
+    // Otherwise the next RefreshCaches() would apply the pending edits to matches already found in the edited content
+    bool isCacheCurrent = !isCompacted && cacheDataVersion != 0 && !hasDirtyRange;
+    if (isCacheCurrent) {
+        matchIndex.Rebuild(gapBuffer);
+    }
+}
+
+void Ionl::TextBuffer::InstallTextRuns(std::vector<TextRun>& newTextRuns) {
+    std::swap(textRuns, newTextRuns);
+    textRunsChange = {};
+    matchIndex.Rebuild(gapBuffer);
+
+    cachedFrontSize = gapBuffer.GetFrontSize();
+    cachedGapSize = gapBuffer.GetGapSize();
+    hasDirtyRange = false;
+    cacheDataVersion += 1;
+}
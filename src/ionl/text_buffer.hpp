@@ -1,67 +1,125 @@
 #pragma once
 
 #include <imgui/imgui.h>
+#include <ionl/edit_history.hpp>
 #include <ionl/gap_buffer.hpp>
 #include <ionl/markdown.hpp>
+#include <ionl/text_search.hpp>
 
+#include <chrono>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
 namespace Ionl {
 
-enum class TextStyleType {
-    Regular,
-    Url,
-    Title_BEGIN,
-    Title1 = Title_BEGIN,
-    Title2,
-    Title3,
-    Title4,
-    Title5,
-    Title_END,
+// A range of paragraphs reparsed by `TextBuffer::RefreshCaches()`, in logical indices.
+struct ReparsedRange {
+    // Range [oldBegin, oldEnd) in the previous content
+    int64_t oldBegin = 0;
+    int64_t oldEnd = 0;
+    // Range [newBegin, newEnd) in the current content, which replaced the previous range; everything after it is shifted by `newEnd - oldEnd`
+    int64_t newBegin = 0;
+    int64_t newEnd = 0;
 };
 
-constexpr int kNumTitleLevels = (int)TextStyleType::Title_END - (int)TextStyleType::Title_BEGIN;
-
-// Heading level: number of #'s used in writing this heading
-// e.g. # Heading -> 1
-//      ## Heading -> 2
-int CalcHeadingLevel(TextStyleType type);
-TextStyleType MakeHeadingLevel(int level);
-bool IsHeading(TextStyleType type);
-
-struct TextStyle {
-    TextStyleType type;
-
-    // Face variants
-    bool isMonospace;
-    bool isBold;
-    bool isItalic;
-    // Decorations
-    bool isUnderline;
-    bool isStrikethrough;
-};
-
-struct TextRun {
-    int64_t begin = 0; // Buffer index
-    int64_t end = 0; // Buffer index
-    TextStyle style = {};
-    bool hasParagraphBreak = false; // Whether to break paragraph at end of this TextRun
+// Describes how `TextBuffer::textRuns` changed in the last `TextBuffer::RefreshCaches()` call.
+struct TextRunsChange {
+    // Whether all TextRun's were regenerated; if so, the rest of the fields are meaningless.
+    bool isFull = true;
+    // Sorted, non-overlapping ranges of reparsed paragraphs. All other TextRun's are the same as before, except for their buffer indices.
+    // The 2 ranges are the edited paragraphs, and the paragraph which the previous gap location was splitting TextRun's in.
+    ReparsedRange ranges[2] = {};
+    int numRanges = 0;
+    // Gap location when the previous TextRun's were generated, for mapping their buffer indices back to logical indices.
+    int64_t prevFrontSize = 0;
+    int64_t prevGapSize = 0;
 };
 
 struct TextBuffer {
+    // Time since the last edit after which ShrinkToFitIfIdle() releases the gap
+    static constexpr std::chrono::steady_clock::duration kDefaultShrinkIdleTime = std::chrono::seconds(30);
+    // Gap left by ShrinkToFit(), enough for a few keystrokes without reallocating
+    static constexpr int64_t kShrunkGapSize = 16;
+
     // Canonical data
     GapBuffer gapBuffer;
+    // While compacted, the content lives here as UTF-8 instead and everything else is empty; see Compact()
+    std::string compactContent;
+    bool isCompacted = false;
+    // Edits made with Insert(), Erase() and Replace(), for Undo() and Redo()
+    EditHistory history;
 
     // Cached data derived from canonical data
     // Invalidation and recomputation should be done by whoever modifies `gapBuffer`.
     std::vector<TextRun> textRuns;
+    TextRunsChange textRunsChange;
+    // Parser and the spare TextRun array which the next `textRuns` is spliced into, kept around to reuse their allocations
+    MdParser parser;
+    std::vector<TextRun> textRunsScratch;
     int cacheDataVersion = 0;
+    // Gap location when `textRuns` was generated. TextRun's store buffer indices, which are only meaningful with the gap at this location.
+    int64_t cachedFrontSize = 0;
+    int64_t cachedGapSize = 0;
+
+    // Edited range since the last RefreshCaches(), in logical indices of the current content
+    int64_t dirtyBegin = 0;
+    int64_t dirtyEnd = 0;
+    int64_t dirtyDelta = 0;
+    bool hasDirtyRange = false;
+    // Time of the last MarkEdited()
+    std::chrono::steady_clock::time_point lastEditTime;
+
+    // Matches of the current search, for highlighting; updated along with `textRuns`, rescanning only the reparsed paragraphs
+    TextMatchIndex matchIndex;
+
+    // If `refreshCaches` is false, cached data is left empty, for when it is generated elsewhere (e.g. by TextBufferBatchParser).
+    explicit TextBuffer(GapBuffer buf, bool refreshCaches = true);
+
+    // Keep only the content as UTF-8, releasing `gapBuffer` and all cached data; undone by Expand()
+    void Compact();
+    // Transcode the content back into `gapBuffer` and regenerate cached data.
+    void Expand();
+
+    // Release most of the gap in `gapBuffer`, remapping cached data instead of regenerating it. Does nothing if there are unrefreshed edits.
+    void ShrinkToFit();
+    // ShrinkToFit() if nothing was edited for `idleTime`. Cheap enough to call every frame for every TextBuffer not being edited.
+    void ShrinkToFitIfIdle(std::chrono::steady_clock::duration idleTime = kDefaultShrinkIdleTime);
+
+    // An immutable copy of the content for reading on other threads, e.g. to parse or save it in the background; see GapBufferSnapshot.
+    // A compacted TextBuffer stays compacted, the snapshot gets transcoded storage of its own.
+    GapBufferSnapshot TakeSnapshot();
+
+    // Insert `size` characters at logical index `idx`, and record the edit with MarkEdited() and into `history`.
+    void Insert(int64_t idx, const ImWchar* text, size_t size);
+    // Erase `size` characters starting at logical index `idx`, and record the edit with MarkEdited() and into `history`.
+    void Erase(int64_t idx, int64_t size);
+    // Replace `removedSize` characters starting at logical index `idx` with `size` new ones, as one edit with a single gap move.
+    void Replace(int64_t idx, int64_t removedSize, const ImWchar* text, size_t size);
+    // Apply many edits at once with Ionl::ApplyEdits(), recorded as one step in `history`. Returns false if the edits are invalid.
+    bool ApplyEdits(std::span<const GapBufferEdit> edits);
+    // Replace `removedSize` characters at logical index `idx` with UTF-8 `text`, e.g. the clipboard. Returns the number of characters inserted.
+    int64_t Paste(int64_t idx, int64_t removedSize, std::string_view text);
 
-    explicit TextBuffer(GapBuffer buf);
+    // Revert the last step in `history`, with a single gap move. Returns the logical index right after the restored text, or -1 if there is
+    // nothing to undo.
+    int64_t Undo();
+    // Reapply the last step reverted by Undo(). Returns the logical index right after the reinserted text, or -1 if there is nothing to redo.
+    int64_t Redo();
 
+    // Record that `removedSize` characters starting at logical index `idx` were replaced by `insertedSize` new characters.
+    // This allows the next RefreshCaches() to reparse only the paragraphs touching the edits.
+    void MarkEdited(int64_t idx, int64_t removedSize, int64_t insertedSize);
+    // Regenerate cached data; if no edits were recorded with MarkEdited(), everything is regenerated.
     void RefreshCaches();
+    // Highlight matches of `searcher` in `matchIndex` from now on; an empty searcher turns it off. If there are edits not yet reflected in
+    // cached data, matches are found by the next RefreshCaches().
+    void SetSearch(TextSearcher searcher);
+    // Replace `textRuns` with TextRun's parsed elsewhere from the entire current content, with the gap at its current location.
+    // The previous TextRun's are swapped into `newTextRuns`.
+    void InstallTextRuns(std::vector<TextRun>& newTextRuns);
 };
 
 } // namespace Ionl
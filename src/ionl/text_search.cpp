@@ -0,0 +1,225 @@
+#include "text_search.hpp"
+
+#include <ionl/simd.hpp>
+
+#include <algorithm>
+#include <utility>
+
+// TODO full Unicode case folding needs ICU, see the word breaking TODO in widget_text_edit.cpp
+ImWchar Ionl::FoldCase(ImWchar c) {
+    if ((c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE && c != 0xD7) || (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) || (c >= 0x410 && c <= 0x42F)) {
+        return (ImWchar)(c + 0x20);
+    }
+    if (c >= 0x400 && c <= 0x40F) {
+        return (ImWchar)(c + 0x50);
+    }
+    return c;
+}
+
+namespace {
+using namespace Ionl;
+
+// Inverse of FoldCase(), for the chars it produces
+ImWchar UnfoldCase(ImWchar c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 0xE0 && c <= 0xFE && c != 0xF7) || (c >= 0x3B1 && c <= 0x3C9 && c != 0x3C2) || (c >= 0x430 && c <= 0x44F)) {
+        return (ImWchar)(c - 0x20);
+    }
+    if (c >= 0x450 && c <= 0x45F) {
+        return (ImWchar)(c - 0x50);
+    }
+    return c;
+}
+} // namespace
+
+Ionl::TextSearcher::TextSearcher(std::span<const ImWchar> needle, TextSearchOptions options)
+    : mNeedle(needle.begin(), needle.end())
+    , mCaseInsensitive{ options.caseInsensitive } //
+{
+    if (mNeedle.empty()) {
+        return;
+    }
+    if (mCaseInsensitive) {
+        std::transform(mNeedle.begin(), mNeedle.end(), mNeedle.begin(), FoldCase);
+    }
+    ImWchar first = mNeedle.front();
+    ImWchar last = mNeedle.back();
+    mFirstChars[0] = first;
+    mFirstChars[1] = mCaseInsensitive ? UnfoldCase(first) : first;
+    mLastChars[0] = last;
+    mLastChars[1] = mCaseInsensitive ? UnfoldCase(last) : last;
+}
+
+int64_t Ionl::TextSearcher::FindNext(const GapBuffer& buf, int64_t begin, int64_t end) const {
+    auto size = (int64_t)mNeedle.size();
+    if (size == 0 || end - begin < size) {
+        return -1;
+    }
+
+    auto [front, back] = buf.Segments(begin, end);
+    auto found = FindInSegment(front.data(), front.data() + front.size());
+    if (found != front.data() + front.size()) {
+        return begin + (found - front.data());
+    }
+
+    // Matches beginning in the last `size - 1` chars before the gap continue after it
+    int64_t gapIdx = begin + (int64_t)front.size();
+    for (int64_t idx = std::max(begin, gapIdx - size + 1); idx < gapIdx && idx + size <= end; ++idx) {
+        if (MatchesAt(buf, idx)) {
+            return idx;
+        }
+    }
+
+    found = FindInSegment(back.data(), back.data() + back.size());
+    if (found != back.data() + back.size()) {
+        return gapIdx + (found - back.data());
+    }
+    return -1;
+}
+
+void Ionl::TextSearcher::FindAll(const GapBuffer& buf, int64_t begin, int64_t end, std::vector<TextSearchMatch>& out) const {
+    auto size = (int64_t)mNeedle.size();
+    while (true) {
+        int64_t idx = FindNext(buf, begin, end);
+        if (idx == -1) {
+            break;
+        }
+        out.push_back(TextSearchMatch{ .begin = idx, .end = idx + size });
+        begin = idx + size;
+    }
+}
+
+bool Ionl::TextSearcher::IsMultiline() const {
+    return std::find(mNeedle.begin(), mNeedle.end(), '\n') != mNeedle.end();
+}
+
+const ImWchar* Ionl::TextSearcher::FindInSegment(const ImWchar* begin, const ImWchar* end) const {
+    auto size = (int64_t)mNeedle.size();
+    if (end - begin < size) {
+        return end;
+    }
+
+    // Last position a match may begin at
+    const ImWchar* lastBegin = end - size;
+    const ImWchar* curr = begin;
+    if constexpr (kCanVectorizeImWchar) {
+#if IONL_SIMD_AVX2
+        __m256i first0 = _mm256_set1_epi16((short)mFirstChars[0]);
+        __m256i first1 = _mm256_set1_epi16((short)mFirstChars[1]);
+        __m256i last0 = _mm256_set1_epi16((short)mLastChars[0]);
+        __m256i last1 = _mm256_set1_epi16((short)mLastChars[1]);
+        // Each lane is a candidate position: its first char is compared here, and its last char in the load `size - 1` chars ahead
+        for (; lastBegin - curr >= 15; curr += 16) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(curr));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(curr + size - 1));
+            __m256i matchesFirst = _mm256_or_si256(_mm256_cmpeq_epi16(a, first0), _mm256_cmpeq_epi16(a, first1));
+            __m256i matchesLast = _mm256_or_si256(_mm256_cmpeq_epi16(b, last0), _mm256_cmpeq_epi16(b, last1));
+            auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(matchesFirst, matchesLast));
+            for (; mask != 0; mask = ClearFirstLane16(mask)) {
+                const ImWchar* candidate = curr + FirstLane16(mask);
+                if (MatchesAt(candidate)) {
+                    return candidate;
+                }
+            }
+        }
+#endif
+#if IONL_SIMD_SSE2
+        __m128i first0x = _mm_set1_epi16((short)mFirstChars[0]);
+        __m128i first1x = _mm_set1_epi16((short)mFirstChars[1]);
+        __m128i last0x = _mm_set1_epi16((short)mLastChars[0]);
+        __m128i last1x = _mm_set1_epi16((short)mLastChars[1]);
+        for (; lastBegin - curr >= 7; curr += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(curr));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(curr + size - 1));
+            __m128i matchesFirst = _mm_or_si128(_mm_cmpeq_epi16(a, first0x), _mm_cmpeq_epi16(a, first1x));
+            __m128i matchesLast = _mm_or_si128(_mm_cmpeq_epi16(b, last0x), _mm_cmpeq_epi16(b, last1x));
+            auto mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(matchesFirst, matchesLast));
+            for (; mask != 0; mask = ClearFirstLane16(mask)) {
+                const ImWchar* candidate = curr + FirstLane16(mask);
+                if (MatchesAt(candidate)) {
+                    return candidate;
+                }
+            }
+        }
+#endif
+    }
+
+    for (; curr <= lastBegin; ++curr) {
+        if ((*curr == mFirstChars[0] || *curr == mFirstChars[1]) && MatchesAt(curr)) {
+            return curr;
+        }
+    }
+    return end;
+}
+
+bool Ionl::TextSearcher::MatchesAt(const ImWchar* text) const {
+    if (mCaseInsensitive) {
+        return std::equal(mNeedle.begin(), mNeedle.end(), text, [](ImWchar needle, ImWchar c) { return needle == FoldCase(c); });
+    }
+    return std::equal(mNeedle.begin(), mNeedle.end(), text);
+}
+
+bool Ionl::TextSearcher::MatchesAt(const GapBuffer& buf, int64_t logicalIdx) const {
+    for (size_t i = 0; i < mNeedle.size(); ++i) {
+        ImWchar c = buf[logicalIdx + i];
+        if (mNeedle[i] != (mCaseInsensitive ? FoldCase(c) : c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Ionl::TextMatchIndex::Reset(TextSearcher searcher) {
+    mSearcher = std::move(searcher);
+    FreeMemory(mMatches);
+    FreeMemory(mScratch);
+    mIsStale = IsActive();
+}
+
+void Ionl::TextMatchIndex::Rebuild(const GapBuffer& buf) {
+    mMatches.clear();
+    mIsStale = false;
+    if (IsActive()) {
+        mSearcher.FindAll(buf, 0, buf.GetContentSize(), mMatches);
+    }
+}
+
+void Ionl::TextMatchIndex::OnEdited(const GapBuffer& buf, int64_t begin, int64_t oldEnd, int64_t newEnd) {
+    if (!IsActive()) {
+        return;
+    }
+    // Greedy matching restarts at every paragraph break only if no match can span one
+    if (mIsStale || mSearcher.IsMultiline()) {
+        Rebuild(buf);
+        return;
+    }
+
+    // Paragraphs are rescanned whole, so every match either lies entirely inside the edited range or entirely outside of it
+    auto first = std::partition_point(mMatches.begin(), mMatches.end(), [&](const TextSearchMatch& m) { return m.begin < begin; });
+    auto last = std::partition_point(first, mMatches.end(), [&](const TextSearchMatch& m) { return m.begin < oldEnd; });
+
+    mScratch.clear();
+    mSearcher.FindAll(buf, begin, newEnd, mScratch);
+
+    int64_t delta = newEnd - oldEnd;
+    for (auto it = last; it != mMatches.end(); ++it) {
+        it->begin += delta;
+        it->end += delta;
+    }
+
+    // Overwrite the old matches in place as far as possible, so that the common case of an edit not changing the number of matches moves nothing
+    auto numOld = last - first;
+    auto numNew = (std::ptrdiff_t)mScratch.size();
+    auto common = std::min(numOld, numNew);
+    auto out = std::copy(mScratch.begin(), mScratch.begin() + common, first);
+    if (numOld > numNew) {
+        mMatches.erase(out, last);
+    } else {
+        mMatches.insert(out, mScratch.begin() + common, mScratch.end());
+    }
+}
+
+std::span<const Ionl::TextSearchMatch> Ionl::TextMatchIndex::FindOverlapping(int64_t begin, int64_t end) const {
+    auto first = std::partition_point(mMatches.begin(), mMatches.end(), [&](const TextSearchMatch& m) { return m.end <= begin; });
+    auto last = std::partition_point(first, mMatches.end(), [&](const TextSearchMatch& m) { return m.begin < end; });
+    return std::span(first, last);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <imgui/imgui.h>
+#include <ionl/gap_buffer.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Ionl {
+
+// The case folding used by case-insensitive searches: ASCII, Latin-1, Greek and Cyrillic capitals map to lowercase, everything else to itself.
+// No mapped pair differs in its UTF-8 length, so folding UTF-8 text char by char keeps byte offsets intact.
+ImWchar FoldCase(ImWchar c);
+
+// An occurrence found by TextSearcher, as the logical range [begin, end).
+struct TextSearchMatch {
+    int64_t begin = 0;
+    int64_t end = 0;
+};
+
+struct TextSearchOptions {
+    // Folds ASCII, Latin-1, Greek and Cyrillic letters; other chars must match exactly
+    bool caseInsensitive = false;
+};
+
+// Finds occurrences of a needle directly in the segments of a GapBuffer, without extracting its content first.
+class TextSearcher {
+private:
+    // Case folded if `mCaseInsensitive`
+    std::vector<ImWchar> mNeedle;
+    // Both cases of the first and last char of the needle, for the vectorized filter; the same char twice if it has no other case
+    ImWchar mFirstChars[2] = {};
+    ImWchar mLastChars[2] = {};
+    bool mCaseInsensitive = false;
+
+public:
+    TextSearcher() = default;
+    explicit TextSearcher(std::span<const ImWchar> needle, TextSearchOptions options = {});
+
+    bool IsEmpty() const { return mNeedle.empty(); }
+    int64_t GetNeedleSize() const { return (int64_t)mNeedle.size(); }
+    // If not, no match can span a paragraph break
+    bool IsMultiline() const;
+
+    // Logical index of the first match that lies within the logical range [begin, end) of `buf`, or -1 if there is none.
+    int64_t FindNext(const GapBuffer& buf, int64_t begin, int64_t end) const;
+    // Append all non-overlapping matches within the logical range [begin, end) of `buf` to `out`, in order.
+    void FindAll(const GapBuffer& buf, int64_t begin, int64_t end, std::vector<TextSearchMatch>& out) const;
+
+private:
+    // Pointer to the first match lying entirely within [begin, end), or `end` if there is none
+    const ImWchar* FindInSegment(const ImWchar* begin, const ImWchar* end) const;
+    bool MatchesAt(const ImWchar* text) const;
+    bool MatchesAt(const GapBuffer& buf, int64_t logicalIdx) const;
+};
+
+// All matches of a TextSearcher in a buffer; an edit only rescans the paragraphs it touched.
+class TextMatchIndex {
+private:
+    TextSearcher mSearcher;
+    // Sorted and non-overlapping
+    std::vector<TextSearchMatch> mMatches;
+    std::vector<TextSearchMatch> mScratch;
+    // Whether `mMatches` are not from the current searcher yet
+    bool mIsStale = false;
+
+public:
+    // Search for `searcher` instead, from the next Rebuild() or OnEdited() on. An empty searcher turns the index off.
+    void Reset(TextSearcher searcher);
+    bool IsActive() const { return !mSearcher.IsEmpty(); }
+
+    // Rescan the entire content of `buf`.
+    void Rebuild(const GapBuffer& buf);
+    // Account for the paragraphs in the logical range [begin, oldEnd) of the previous content being replaced by [begin, newEnd) of `buf`.
+    void OnEdited(const GapBuffer& buf, int64_t begin, int64_t oldEnd, int64_t newEnd);
+
+    std::span<const TextSearchMatch> GetMatches() const { return mMatches; }
+    // The matches overlapping the logical range [begin, end), found with binary search.
+    std::span<const TextSearchMatch> FindOverlapping(int64_t begin, int64_t end) const;
+};
+
+} // namespace Ionl
@@ -0,0 +1,197 @@
+#include "utf8.hpp"
+
+#include <ionl/simd.hpp>
+#include <imgui/imgui_internal.h>
+
+#include <bit>
+#include <cstdint>
+
+namespace {
+using namespace Ionl;
+
+// If `kCountOnly`, nothing is written and `out` may be null, so that counting takes exactly the same decisions as decoding
+template <bool kNormalizeNewlines, bool kCountOnly>
+size_t TranscodeUtf8ToImWcharImpl(const char* begin, const char* end, ImWchar* out) {
+    auto src = reinterpret_cast<const unsigned char*>(begin);
+    auto srcEnd = reinterpret_cast<const unsigned char*>(end);
+    size_t dst = 0;
+    auto put = [&](ImWchar c) {
+        if constexpr (!kCountOnly) {
+            out[dst] = c;
+        }
+        dst += 1;
+    };
+
+    while (src < srcEnd) {
+        // Widen runs of ASCII a vector at a time, which covers nearly all of ASCII-heavy text
+        if constexpr (kCanVectorizeImWchar) {
+#if IONL_SIMD_AVX2
+            while (srcEnd - src >= 32) {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+                if (_mm256_movemask_epi8(chunk) != 0) {
+                    break;
+                }
+                if constexpr (!kCountOnly) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + dst), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(chunk)));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + dst + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(chunk, 1)));
+                }
+                if constexpr (kNormalizeNewlines) {
+                    auto crMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r')));
+                    if (crMask != 0) {
+                        // Keep what was stored up to the first '\r' and stay in the vectorized loop, CRLF text has one on every line
+                        auto n = std::countr_zero(crMask);
+                        src += n;
+                        dst += n;
+                        put('\n');
+                        src += srcEnd - src >= 2 && src[1] == '\n' ? 2 : 1;
+                        continue;
+                    }
+                }
+                src += 32;
+                dst += 32;
+            }
+#endif
+#if IONL_SIMD_SSE2
+            while (srcEnd - src >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                if (_mm_movemask_epi8(chunk) != 0) {
+                    break;
+                }
+                if constexpr (!kCountOnly) {
+                    __m128i zero = _mm_setzero_si128();
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + dst), _mm_unpacklo_epi8(chunk, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + dst + 8), _mm_unpackhi_epi8(chunk, zero));
+                }
+                if constexpr (kNormalizeNewlines) {
+                    auto crMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+                    if (crMask != 0) {
+                        auto n = std::countr_zero(crMask);
+                        src += n;
+                        dst += n;
+                        put('\n');
+                        src += srcEnd - src >= 2 && src[1] == '\n' ? 2 : 1;
+                        continue;
+                    }
+                }
+                src += 16;
+                dst += 16;
+            }
+#endif
+        }
+
+        // The next 16 bytes contain a non-ASCII char (or this is the tail of the input), decode them one char at a time before trying the vectorized path again
+        auto scalarEnd = srcEnd - src >= 16 ? src + 16 : srcEnd;
+        while (src < scalarEnd) {
+            unsigned int c0 = src[0];
+            auto remaining = srcEnd - src;
+            if (kNormalizeNewlines && c0 == '\r') {
+                put('\n');
+                src += remaining >= 2 && src[1] == '\n' ? 2 : 1;
+                continue;
+            }
+            if (c0 < 0x80) {
+                put((ImWchar)c0);
+                src += 1;
+                continue;
+            }
+
+            // Inline the well-formed 2 and 3 byte sequences, which is all of e.g. Latin, Cyrillic and CJK text
+            if (c0 >= 0xC2 && c0 < 0xE0 && remaining >= 2 && (src[1] & 0xC0) == 0x80) {
+                put((ImWchar)(((c0 & 0x1F) << 6) | (src[1] & 0x3F)));
+                src += 2;
+                continue;
+            }
+            if ((c0 & 0xF0) == 0xE0 && remaining >= 3 && (src[1] & 0xC0) == 0x80 && (src[2] & 0xC0) == 0x80) {
+                unsigned int c = ((c0 & 0x0F) << 12) | ((src[1] & 0x3F) << 6) | (src[2] & 0x3F);
+                // Overlong encodings and surrogate halves are errors
+                if (c >= 0x800 && (c < 0xD800 || c > 0xDFFF)) {
+                    put((ImWchar)c);
+                    src += 3;
+                    continue;
+                }
+            }
+
+            // 4 byte sequences and malformed input
+            unsigned int c;
+            src += ImTextCharFromUtf8(&c, reinterpret_cast<const char*>(src), reinterpret_cast<const char*>(srcEnd));
+            put((ImWchar)c);
+        }
+    }
+
+    return dst;
+}
+} // namespace
+
+size_t Ionl::TranscodeUtf8ToImWchar(const char* begin, const char* end, ImWchar* out) {
+    return TranscodeUtf8ToImWcharImpl<false, false>(begin, end, out);
+}
+
+size_t Ionl::TranscodeUtf8ToImWcharNormalizingNewlines(const char* begin, const char* end, ImWchar* out) {
+    return TranscodeUtf8ToImWcharImpl<true, false>(begin, end, out);
+}
+
+size_t Ionl::CountUtf8ToImWchar(const char* begin, const char* end) {
+    return TranscodeUtf8ToImWcharImpl<false, true>(begin, end, nullptr);
+}
+
+size_t Ionl::CountUtf8ToImWcharNormalizingNewlines(const char* begin, const char* end) {
+    return TranscodeUtf8ToImWcharImpl<true, true>(begin, end, nullptr);
+}
+
+size_t Ionl::TranscodeImWcharToUtf8(const ImWchar* begin, const ImWchar* end, char* out) {
+    const ImWchar* src = begin;
+    char* dst = out;
+
+    while (src < end) {
+        // Narrow runs of ASCII a vector at a time
+        if constexpr (kCanVectorizeImWchar) {
+#if IONL_SIMD_AVX2
+            for (; end - src >= 32; src += 32, dst += 32) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 16));
+                __m256i nonAscii = _mm256_and_si256(_mm256_or_si256(a, b), _mm256_set1_epi16((short)0xFF80));
+                if (!_mm256_testz_si256(nonAscii, nonAscii)) {
+                    break;
+                }
+                // The pack works within 128-bit lanes, putting the 64-bit quarters in the order a0 b0 a1 b1
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0b11'01'10'00);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), packed);
+            }
+#endif
+#if IONL_SIMD_SSE2
+            for (; end - src >= 16; src += 16, dst += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+                __m128i nonAscii = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16((short)0xFF80));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(nonAscii, _mm_setzero_si128())) != 0xFFFF) {
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(a, b));
+            }
+#endif
+        }
+
+        auto scalarEnd = end - src >= 16 ? src + 16 : end;
+        for (; src < scalarEnd; ++src) {
+            unsigned int c = *src;
+            if (c < 0x80) {
+                *dst++ = (char)c;
+            } else if (c < 0x800) {
+                *dst++ = (char)(0xC0 | (c >> 6));
+                *dst++ = (char)(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                *dst++ = (char)(0xE0 | (c >> 12));
+                *dst++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *dst++ = (char)(0x80 | (c & 0x3F));
+            } else if (c <= 0x10FFFF) {
+                *dst++ = (char)(0xF0 | (c >> 18));
+                *dst++ = (char)(0x80 | ((c >> 12) & 0x3F));
+                *dst++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *dst++ = (char)(0x80 | (c & 0x3F));
+            }
+            // Anything above is not a code point, and is dropped like ImTextStrToUtf8() does
+        }
+    }
+
+    return dst - out;
+}
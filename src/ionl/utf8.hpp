@@ -0,0 +1,25 @@
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <cstddef>
+
+namespace Ionl {
+
+// Upper bound of the number of UTF-8 bytes a single ImWchar encodes into.
+constexpr size_t kMaxUtf8BytesPerImWchar = sizeof(ImWchar) == 2 ? 3 : 4;
+
+// Decode the UTF-8 text [begin, end) into `out`, which must have room for `end - begin` ImWchar's. Returns the number of ImWchar's written.
+// Unlike ImTextStrFromUtf8(), NUL doesn't end the input.
+size_t TranscodeUtf8ToImWchar(const char* begin, const char* end, ImWchar* out);
+// Same as TranscodeUtf8ToImWchar(), additionally replacing "\r\n" and lone '\r' with '\n' as required for text imported into a buffer.
+size_t TranscodeUtf8ToImWcharNormalizingNewlines(const char* begin, const char* end, ImWchar* out);
+// Number of ImWchar's TranscodeUtf8ToImWchar() and TranscodeUtf8ToImWcharNormalizingNewlines() would write, for sizing `out` exactly.
+size_t CountUtf8ToImWchar(const char* begin, const char* end);
+size_t CountUtf8ToImWcharNormalizingNewlines(const char* begin, const char* end);
+
+// Encode [begin, end) as UTF-8 into `out`, which must have room for `(end - begin) * kMaxUtf8BytesPerImWchar` bytes.
+// Returns the number of bytes written.
+size_t TranscodeImWcharToUtf8(const ImWchar* begin, const ImWchar* end, char* out);
+
+} // namespace Ionl
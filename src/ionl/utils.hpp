@@ -3,6 +3,12 @@
 #include <utility>
 #include <variant>
 
+// Release what `obj` holds by replacing it with a default constructed one; clear() keeps the capacity of containers
+template <typename T>
+void FreeMemory(T& obj) {
+    obj = T();
+}
+
 template <typename... Ts>
 struct Overloaded : Ts... {
     using Ts::operator()...;
@@ -1,6 +1,7 @@
 #include "widget_text_edit.hpp"
 
 #include <imgui/imgui_internal.h>
+#include <ionl/utf8.hpp>
 
 #include <algorithm>
 #include <cassert>
@@ -31,6 +32,8 @@ const char* TextStyleTypeToString(TextStyleType type) {
         using enum TextStyleType;
         case Regular: return "Reg";
         case Url: return "URL";
+        case CodeBlock: return "Code";
+        case CodeBlockClosingFence: return "CodeEnd";
 
         // We can ignore headings
         default: return nullptr;
@@ -149,11 +152,29 @@ const char* StringifyCursorAffinity(CursorAffinity v) {
 }
 #endif
 
-ImVec2 CalcSubTextRunDim(const TextBuffer& tb, const TextRun& tr, int64_t idxBeg, int64_t idxEnd) {
-    auto& face = gMarkdownStylesheet.LookupFace(tr.style);
-    auto beg = &tb.gapBuffer.buffer[idxBeg];
-    auto end = &tb.gapBuffer.buffer[idxEnd];
-    return face.font->CalcTextSize(face.font->FontSize, std::numeric_limits<float>::max(), 0.0f, beg, end);
+// Horizontal offset of the glyph at `bufferIdx` from the beginning of the GlyphRun, where `bufferIdx` is in [gr.tr.begin, gr.tr.end].
+float CalcGlyphRunOffset(const GlyphRun& gr, int64_t bufferIdx) {
+    auto n = std::min<int64_t>(bufferIdx - gr.tr.begin, gr.prefixAdvances.size());
+    return n <= 0 ? 0.0f : gr.prefixAdvances[n - 1];
+}
+
+// Find the buffer index in the GlyphRun closest to the horizontal offset `x`, relative to the beginning of the GlyphRun.
+// A position is considered to land between two glyphs 'ab' if it's between the halfway points of both glyphs.
+// Returns gr.tr.end if `x` is past the halfway point of the last glyph.
+int64_t CalcGlyphRunIndexAtOffset(const GlyphRun& gr, float x) {
+    const auto& advances = gr.prefixAdvances;
+    size_t lo = 0;
+    size_t hi = advances.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        float glyphBegin = mid == 0 ? 0.0f : advances[mid - 1];
+        if (x < (glyphBegin + advances[mid]) / 2) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return gr.tr.begin + static_cast<int64_t>(lo);
 }
 
 struct LayoutInput {
@@ -165,6 +186,10 @@ struct LayoutInput {
     std::span<const TextRun> textRuns;
     // [Optional] Width to wrap lines at; set to 0.0f to ignore line width.
     float viewportWidth = std::numeric_limits<float>::max();
+    // [Optional] Vertical range [visibleBegin, visibleEnd) in the output's space. Paragraphs entirely outside of it are not laid out;
+    // placeholder GlyphRun's with an estimated height are generated for them instead.
+    float visibleBegin = -std::numeric_limits<float>::max();
+    float visibleEnd = std::numeric_limits<float>::max();
 };
 
 struct LayoutOutput {
@@ -172,6 +197,20 @@ struct LayoutOutput {
     ImVec2 boundingBox;
 };
 
+// Estimate the height of a paragraph without laying it out, assuming all characters to be as wide as an 'x' of the first TextRun's face.
+// Does not include paragraph padding.
+float EstimateParagraphHeight(const LayoutInput& in, std::span<const TextRun> paragraph) {
+    auto& face = in.styles->LookupFace(paragraph.front().style);
+    int64_t numChars = 0;
+    for (const auto& textRun : paragraph) {
+        numChars += textRun.end - textRun.begin;
+    }
+
+    float width = numChars * face.font->GetCharAdvance('x');
+    float numLines = in.viewportWidth > 0.0f ? ImMax(ImCeil(width / in.viewportWidth), 1.0f) : 1.0f;
+    return numLines * face.font->FontSize + (numLines - 1.0f) * in.styles->linePadding;
+}
+
 // TODO might be an idea to stop showing any text if viewportWidth is smaller than a certain threshold
 LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
     LayoutOutput out;
@@ -180,9 +219,36 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
     ImVec2 currLineDim{};
     bool isBeginningOfParagraph = true;
 
-    for (const auto& textRun : in.textRuns) {
+    for (auto it = in.textRuns.begin(); it != in.textRuns.end(); ++it) {
+        const auto& textRun = *it;
         auto& face = in.styles->LookupFace(textRun.style);
 
+        if (isBeginningOfParagraph &&
+            (in.visibleBegin != -std::numeric_limits<float>::max() || in.visibleEnd != std::numeric_limits<float>::max()))
+        {
+            auto paragraphEnd = std::find_if(it, in.textRuns.end(), [](const TextRun& tr) { return tr.hasParagraphBreak; });
+            if (paragraphEnd != in.textRuns.end()) ++paragraphEnd;
+
+            float height = EstimateParagraphHeight(in, std::span(it, paragraphEnd));
+            if (currPos.y >= in.visibleEnd || currPos.y + height <= in.visibleBegin) {
+                for (auto jt = it; jt != paragraphEnd; ++jt) {
+                    GlyphRun placeholder;
+                    placeholder.tr = *jt;
+                    placeholder.pos = currPos;
+                    placeholder.height = jt == it ? height : 0.0f;
+                    placeholder.isPlaceholder = true;
+                    out.glyphRuns.push_back(std::move(placeholder));
+                }
+
+                float advance = height + (std::prev(paragraphEnd)->hasParagraphBreak ? in.styles->paragraphPadding : 0.0f);
+                currPos.y += advance;
+                out.boundingBox.y += advance;
+
+                it = std::prev(paragraphEnd);
+                continue;
+            }
+        }
+
         isBeginningOfParagraph = false;
 
         const ImWchar* beg = &in.src->buffer[textRun.begin];
@@ -218,6 +284,12 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
             glyphRun.pos = currPos;
             glyphRun.horizontalAdvance = runDim.x;
             glyphRun.height = runDim.y;
+            glyphRun.prefixAdvances.reserve(remaining - beg);
+            float advance = 0.0f;
+            for (auto it = beg; it != remaining; ++it) {
+                advance += face.font->GetCharAdvance(*it);
+                glyphRun.prefixAdvances.push_back(advance);
+            }
             out.glyphRuns.push_back(std::move(glyphRun));
 
             currPos.x += runDim.x;
@@ -264,21 +336,218 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
     return out;
 }
 
-void RefreshTextEditCachedData(TextEdit& te, float viewportWidth) {
+// Re-lay only the paragraphs described by `TextBuffer::textRunsChange`. Returns false if a full relayout is necessary.
+bool RelayChangedParagraphs(TextEdit& te, float viewportWidth, float visibleBegin, float visibleEnd) {
     TextBuffer& tb = *te._tb;
+    const GapBuffer& buf = tb.gapBuffer;
+    const TextRunsChange& change = tb.textRunsChange;
+    if (change.isFull) {
+        return false;
+    }
+
+    auto& oldGlyphRuns = te._cachedGlyphRuns;
+    auto mapOldIndex = [&](int64_t bufferIdx) {
+        return bufferIdx < change.prevFrontSize ? bufferIdx : bufferIdx - change.prevGapSize;
+    };
+
+    std::vector<GlyphRun> glyphRuns;
+    glyphRuns.reserve(oldGlyphRuns.size());
+
+    // Logical shift and vertical shift for the unchanged GlyphRun's at the current location
+    int64_t delta = 0;
+    float dy = 0.0f;
+
+    // Move an unchanged GlyphRun to the new gap location, shifted by `delta` characters and `dy` vertically
+    // Fails if the run now straddles the gap, which can only happen when the gap was moved without going through TextBuffer::MarkEdited()
+    auto pushRemapped = [&](GlyphRun gr) {
+        int64_t size = gr.tr.end - gr.tr.begin;
+        int64_t logicalBegin = mapOldIndex(gr.tr.begin) + delta;
+        if (logicalBegin < buf.frontSize && logicalBegin + size > buf.frontSize) {
+            return false;
+        }
+        gr.tr.begin = MapLogicalIndexToBufferIndex(buf, logicalBegin);
+        gr.tr.end = gr.tr.begin + size;
+        gr.pos.y += dy;
+        glyphRuns.push_back(std::move(gr));
+        return true;
+    };
+
+    // Both TextRun's and GlyphRun's are sorted by their location in the buffer, so each range of paragraphs is contiguous in both
+    auto oldIt = oldGlyphRuns.begin();
+    for (int i = 0; i < change.numRanges; ++i) {
+        const auto& range = change.ranges[i];
+
+        auto oldRangeBegin = std::partition_point(oldIt, oldGlyphRuns.end(), [&](const GlyphRun& gr) {
+            return mapOldIndex(gr.tr.begin) < range.oldBegin;
+        });
+        auto oldRangeEnd = std::partition_point(oldRangeBegin, oldGlyphRuns.end(), [&](const GlyphRun& gr) {
+            return mapOldIndex(gr.tr.begin) < range.oldEnd;
+        });
+        auto trBegin = std::partition_point(tb.textRuns.begin(), tb.textRuns.end(), [&](const TextRun& tr) {
+            return MapBufferIndexToLogicalIndex(buf, tr.begin) < range.newBegin;
+        });
+        auto trEnd = std::partition_point(trBegin, tb.textRuns.end(), [&](const TextRun& tr) {
+            return MapBufferIndexToLogicalIndex(buf, tr.begin) < range.newEnd;
+        });
+
+        for (; oldIt != oldRangeBegin; ++oldIt) {
+            if (!pushRemapped(std::move(*oldIt))) return false;
+        }
+
+        // The first GlyphRun of a paragraph is always placed at its top left corner
+        float oldBottom = oldRangeEnd != oldGlyphRuns.end() ? oldRangeEnd->pos.y : te._cachedContentHeight;
+        float oldTop = oldRangeBegin != oldRangeEnd ? oldRangeBegin->pos.y : oldBottom;
+
+        // Visible range is given in text canvas space, which is shifted here
+        float top = oldTop + dy;
+        auto res = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &buf,
+            .textRuns = std::span(trBegin, trEnd),
+            .viewportWidth = viewportWidth,
+            .visibleBegin = visibleBegin - top,
+            .visibleEnd = visibleEnd - top,
+        });
+        for (auto& gr : res.glyphRuns) {
+            gr.pos.y += top;
+            glyphRuns.push_back(std::move(gr));
+        }
+
+        dy += res.boundingBox.y - (oldBottom - oldTop);
+        delta = range.newEnd - range.oldEnd;
+        oldIt = oldRangeEnd;
+    }
+    for (; oldIt != oldGlyphRuns.end(); ++oldIt) {
+        if (!pushRemapped(std::move(*oldIt))) return false;
+    }
+
+    te._cachedGlyphRuns = std::move(glyphRuns);
+    te._cachedContentHeight += dy;
+    return true;
+}
+
+// Lay out the placeholder paragraphs intersecting the vertical range [visibleBegin, visibleEnd), replacing their estimated heights with the real ones.
+void LayPlaceholderParagraphs(TextEdit& te, float visibleBegin, float visibleEnd) {
+    auto& oldGlyphRuns = te._cachedGlyphRuns;
+
+    // GlyphRun's are sorted by their y position; start from the paragraph containing the last GlyphRun above the range, as it might extend into the range
+    auto it = std::partition_point(oldGlyphRuns.begin(), oldGlyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.pos.y < visibleBegin;
+    });
+    if (it != oldGlyphRuns.begin()) {
+        --it;
+        while (it != oldGlyphRuns.begin() && !std::prev(it)->tr.hasParagraphBreak) {
+            --it;
+        }
+    }
+
+    std::vector<GlyphRun> glyphRuns;
+    std::vector<TextRun> textRuns;
+    // Everything before this has been moved to `glyphRuns`
+    auto copiedUntil = oldGlyphRuns.begin();
+    float dy = 0.0f;
+    auto copyUntil = [&](std::vector<GlyphRun>::iterator end) {
+        for (; copiedUntil != end; ++copiedUntil) {
+            glyphRuns.push_back(std::move(*copiedUntil));
+            glyphRuns.back().pos.y += dy;
+        }
+    };
+
+    while (it != oldGlyphRuns.end() && it->pos.y + dy < visibleEnd) {
+        auto paragraphEnd = std::find_if(it, oldGlyphRuns.end(), [](const GlyphRun& gr) { return gr.tr.hasParagraphBreak; });
+        if (paragraphEnd != oldGlyphRuns.end()) ++paragraphEnd;
+
+        float top = it->pos.y + dy;
+        float oldHeight = (paragraphEnd != oldGlyphRuns.end() ? paragraphEnd->pos.y : te._cachedContentHeight) - it->pos.y;
+        if (!it->isPlaceholder || top + oldHeight <= visibleBegin) {
+            it = paragraphEnd;
+            continue;
+        }
+
+        if (glyphRuns.empty()) {
+            glyphRuns.reserve(oldGlyphRuns.size());
+        }
+        copyUntil(it);
+
+        textRuns.clear();
+        for (; it != paragraphEnd; ++it) {
+            textRuns.push_back(it->tr);
+        }
+        auto res = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &te._tb->gapBuffer,
+            .textRuns = std::span(textRuns),
+            .viewportWidth = te._cachedViewportWidth,
+        });
+        for (auto& gr : res.glyphRuns) {
+            gr.pos.y += top;
+            glyphRuns.push_back(std::move(gr));
+        }
+
+        dy += res.boundingBox.y - oldHeight;
+        copiedUntil = paragraphEnd;
+    }
+
+    if (copiedUntil == oldGlyphRuns.begin()) {
+        // Nothing changed
+        return;
+    }
+    copyUntil(oldGlyphRuns.end());
+
+    te._cachedGlyphRuns = std::move(glyphRuns);
+    te._cachedContentHeight += dy;
+}
+
+void RefreshTextEditCachedData(TextEdit& te, float viewportWidth, float visibleBegin, float visibleEnd) {
+    TextBuffer& tb = *te._tb;
+
+    // Compacted TextBuffer's only have UTF-8 content, bring back the ImWchar content and TextRun's to lay them out
+    if (tb.isCompacted) {
+        tb.Expand();
+    }
 
     if (te._cachedDataVersion == tb.cacheDataVersion &&
         te._cachedViewportWidth == viewportWidth) {
+        if (te._virtualizeLayout) {
+            LayPlaceholderParagraphs(te, visibleBegin, visibleEnd);
+        }
         return;
     }
     // There must be a bug if we somehow have a newer version in the TextEdit (downstream) than its corresponding TextBuffer (upstream)
     assert(te._cachedDataVersion <= tb.cacheDataVersion);
 
+    // With some hysteresis, so that edits around the threshold don't keep switching between the two
+    int64_t contentSize = tb.gapBuffer.GetContentSize();
+    bool virtualize = contentSize >= (te._virtualizeLayout ? TextEdit::kVirtualizeLayoutThreshold / 2 : TextEdit::kVirtualizeLayoutThreshold);
+#if IONL_DEBUG_FEATURES
+    virtualize |= te._debugForceVirtualizeLayout;
+#endif
+    // Switching needs a full relayout, e.g. placeholders would never be laid out after turning virtualization off
+    bool isSwitching = virtualize != te._virtualizeLayout;
+    te._virtualizeLayout = virtualize;
+
+    if (!te._virtualizeLayout) {
+        visibleBegin = -std::numeric_limits<float>::max();
+        visibleEnd = std::numeric_limits<float>::max();
+    }
+
+    // `TextBuffer::textRunsChange` only describes the difference from the immediately preceding version
+    if (!isSwitching &&
+        te._cachedDataVersion + 1 == tb.cacheDataVersion &&
+        te._cachedViewportWidth == viewportWidth &&
+        RelayChangedParagraphs(te, viewportWidth, visibleBegin, visibleEnd))
+    {
+        te._cachedDataVersion = tb.cacheDataVersion;
+        return;
+    }
+
     auto res = LayMarkdownTextRuns({
         .styles = &gMarkdownStylesheet,
         .src = &tb.gapBuffer,
         .textRuns = std::span(tb.textRuns),
         .viewportWidth = viewportWidth,
+        .visibleBegin = visibleBegin,
+        .visibleEnd = visibleEnd,
     });
 
     te._cachedGlyphRuns = std::move(res.glyphRuns);
@@ -318,72 +587,88 @@ int64_t CalcAdjacentWordPos(GapBuffer& buf, int64_t logicalIndex, int delta) {
     return logicalIndex;
 }
 
+// GlyphRun's are sorted both by their buffer indices and by their y positions, and all GlyphRun's on the same line share the same y position.
+// Hence the GlyphRun array doubles as a sorted index over both, and all lookups below are binary searches.
+
+// Find the range [begin, end) of GlyphRun's on the same line as `glyphRunIdx`.
+std::pair<size_t, size_t> FindLineRange(std::span<const GlyphRun> glyphRuns, size_t glyphRunIdx) {
+    float y = glyphRuns[glyphRunIdx].pos.y;
+    auto begin = std::partition_point(glyphRuns.begin(), glyphRuns.begin() + glyphRunIdx, [&](const GlyphRun& gr) {
+        return gr.pos.y < y;
+    });
+    auto end = std::partition_point(glyphRuns.begin() + glyphRunIdx, glyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.pos.y <= y;
+    });
+    return { std::distance(glyphRuns.begin(), begin), std::distance(glyphRuns.begin(), end) };
+}
+
 std::pair<size_t, int64_t> FindLineWrapBeforeIndex(std::span<const GlyphRun> glyphRuns, size_t startingGlyphRunIdx) {
     assert(!glyphRuns.empty());
-    for (size_t i = startingGlyphRunIdx; i != -1; --i) {
-        auto& glyphRun = glyphRuns[i];
-        // Prioritize paragraph breaks over soft wrapping
-        if (glyphRun.tr.hasParagraphBreak && i != startingGlyphRunIdx) {
-            return { i + 1, glyphRuns[i + 1].tr.begin };
-        }
-        if (glyphRun.isSoftWrapped) {
-            return { i, glyphRun.tr.begin };
-        }
-    }
-    // We consider the very first GlyphRun wrapped, for cursor moving to it
-    return { 0, glyphRuns.front().tr.begin };
+    // The very first GlyphRun is also considered wrapped, for cursor moving to it
+    auto [lineBegin, lineEnd] = FindLineRange(glyphRuns, startingGlyphRunIdx);
+    return { lineBegin, glyphRuns[lineBegin].tr.begin };
 }
 
 std::pair<size_t, int64_t> FindLineWrapAfterIndex(std::span<const GlyphRun> glyphRuns, size_t startingGlyphRunIdx) {
     assert(!glyphRuns.empty());
-    for (size_t i = startingGlyphRunIdx; i < glyphRuns.size(); ++i) {
-        auto& glyphRun = glyphRuns[i];
-        if (glyphRun.isSoftWrapped && i != startingGlyphRunIdx) {
-            return { i, glyphRun.tr.begin };
-        }
-        if (glyphRun.tr.hasParagraphBreak) {
-            return { i, glyphRun.tr.end };
-        }
+    auto [lineBegin, lineEnd] = FindLineRange(glyphRuns, startingGlyphRunIdx);
+    auto& lastGlyphRun = glyphRuns[lineEnd - 1];
+    if (lastGlyphRun.tr.hasParagraphBreak) {
+        return { lineEnd - 1, lastGlyphRun.tr.end };
+    }
+    if (lineEnd < glyphRuns.size()) {
+        // Next line is soft wrapped
+        return { lineEnd, glyphRuns[lineEnd].tr.begin };
     }
     // Similarly, the very last GlyphRun is considered wrapped, for cursor moving to it
     return { glyphRuns.size() - 1, glyphRuns.back().tr.end };
 }
 
-size_t FindGlyphRunContainingIndex(std::span<const GlyphRun> glyphRuns, size_t startingGlyphRunIdx, int64_t bufferIndex) {
+size_t FindGlyphRunContainingIndex(std::span<const GlyphRun> glyphRuns, int64_t bufferIndex) {
     assert(!glyphRuns.empty());
-    auto& startingGlyphRun = glyphRuns[startingGlyphRunIdx];
-
-    int delta;
-    size_t bound;
-    if (bufferIndex < startingGlyphRun.tr.begin) {
-        // Target index is before starting point
-        delta = -1;
-        bound = static_cast<size_t>(-1);
-    } else {
-        // Target index is after starting point
-        delta = 1;
-        bound = glyphRuns.size();
-    }
 
-    for (size_t i = startingGlyphRunIdx; i != bound; i += delta) {
-        auto& r = glyphRuns[i];
+    // Last GlyphRun beginning at or before the index
+    auto it = std::partition_point(glyphRuns.begin(), glyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.tr.begin <= bufferIndex;
+    });
+    if (it == glyphRuns.begin()) {
+        return -1;
+    }
+    auto& r = *std::prev(it);
 
-        if (bufferIndex >= r.tr.begin && bufferIndex < r.tr.end) {
-            return i;
-        }
+    if (bufferIndex >= r.tr.begin && bufferIndex < r.tr.end) {
+        return std::distance(glyphRuns.begin(), it) - 1;
+    }
 
-        // We also consider cursor on \n to be inside the GlyphRun that the \n belongs to
-        if (r.tr.hasParagraphBreak && bufferIndex == r.tr.end) {
-            return i;
-        }
+    // We also consider cursor on \n to be inside the GlyphRun that the \n belongs to
+    if (r.tr.hasParagraphBreak && bufferIndex == r.tr.end) {
+        return std::distance(glyphRuns.begin(), it) - 1;
     }
 
     return -1;
 }
 
+size_t FindGlyphRunContainingCursor(const TextEdit& te, int64_t cursorBufIdx) {
+    size_t res = FindGlyphRunContainingIndex(te._cachedGlyphRuns, cursorBufIdx);
+    if (res == (size_t)-1) {
+        // Cursor is not contained in any GlyphRun, e.g. at the end of document or on an empty line; use the closest one before it
+        auto it = std::partition_point(te._cachedGlyphRuns.begin(), te._cachedGlyphRuns.end(), [&](const GlyphRun& gr) {
+            return gr.tr.begin <= cursorBufIdx;
+        });
+        return it == te._cachedGlyphRuns.begin() ? 0 : std::distance(te._cachedGlyphRuns.begin(), it) - 1;
+    }
+    return res;
+}
+
 void RefreshCursorState(TextEdit& te) {
     auto cursorBufIdx = MapLogicalIndexToBufferIndex(te._tb->gapBuffer, te._cursorIdx);
-    te._cursorCurrGlyphRun = FindGlyphRunContainingIndex(te._cachedGlyphRuns, te._cursorCurrGlyphRun, cursorBufIdx);
+    te._cursorCurrGlyphRun = FindGlyphRunContainingCursor(te, cursorBufIdx);
+    if (te._cachedGlyphRuns[te._cursorCurrGlyphRun].isPlaceholder) {
+        // Cursor moved into a paragraph that is not laid out yet, e.g. by Ctrl+End; lay it out now, and find the real GlyphRun
+        float top = te._cachedGlyphRuns[te._cursorCurrGlyphRun].pos.y;
+        LayPlaceholderParagraphs(te, top, top + 1.0f);
+        te._cursorCurrGlyphRun = FindGlyphRunContainingCursor(te, cursorBufIdx);
+    }
     auto cursorGr = &te._cachedGlyphRuns[te._cursorCurrGlyphRun];
 
     te._cursorIsAtWrapPoint = cursorGr->isSoftWrapped && cursorGr->tr.begin == cursorBufIdx;
@@ -399,7 +684,7 @@ void RefreshCursorState(TextEdit& te) {
     } else {
         visualGr = cursorGr;
         // Calculate width of text between start of GlyphRun to cursor
-        xOff = CalcSubTextRunDim(*te._tb, visualGr->tr, visualGr->tr.begin, cursorBufIdx).x;
+        xOff = CalcGlyphRunOffset(*visualGr, cursorBufIdx);
     }
     te._cursorVisualHeight = visualGr->height;
     te._cursorVisualOffset.x = visualGr->pos.x + xOff;
@@ -408,29 +693,26 @@ void RefreshCursorState(TextEdit& te) {
 
 // mouseX and mouseY should center on draw origin
 std::pair<int64_t, CursorAffinity> CalcCursorStateFromMouse(const TextEdit& te, float mouseX, float mouseY) {
-    auto it = te._cachedGlyphRuns.begin();
+    auto& glyphRuns = te._cachedGlyphRuns;
 
-    // Advance to the desired line by searching vertically
-    while (it != te._cachedGlyphRuns.end()) {
-        if (it->pos.y + it->height >= mouseY) {
-            break;
-        }
-        ++it;
+    // Find the desired line by searching vertically: the last line starting above the mouse, unless the mouse is below all of its GlyphRun's
+    // (e.g. inside paragraph padding), in which case the next line
+    auto it = std::partition_point(glyphRuns.begin(), glyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.pos.y <= mouseY;
+    });
+    if (it != glyphRuns.begin()) {
+        auto [lineBegin, lineEnd] = FindLineRange(glyphRuns, std::distance(glyphRuns.begin(), it) - 1);
+        bool isInsideLine = std::any_of(glyphRuns.begin() + lineBegin, glyphRuns.begin() + lineEnd, [&](const GlyphRun& gr) {
+            return gr.pos.y + gr.height >= mouseY;
+        });
+        it = glyphRuns.begin() + (isInsideLine ? lineBegin : lineEnd);
     }
 
     auto lineBegin = it;
     while (it != te._cachedGlyphRuns.end()) {
-        auto& face = gMarkdownStylesheet.LookupFace(it->tr.style);
-        float x = it->pos.x;
-        for (int64_t i = it->tr.begin; i < it->tr.end; ++i) {
-            ImWchar ch = te._tb->gapBuffer.buffer[i];
-            float w = face.font->GetCharAdvance(ch);
-            // We consider the cursor to land between two characters 'ab' if it's between the halfway point of both glyphs
-            // (if the cursor is inside the latter half of 'a', it will be caught by the iteration of 'b')
-            if (mouseX < (x + w / 2)) {
-                return { i, CursorAffinity::Irrelevant };
-            }
-            x += w;
+        int64_t idx = CalcGlyphRunIndexAtOffset(*it, mouseX - it->pos.x);
+        if (idx < it->tr.end) {
+            return { idx, CursorAffinity::Irrelevant };
         }
 
         // Reached end of line, declare cursor to be on the last char
@@ -463,22 +745,41 @@ bool FilterInputCharacter(ImWchar c) {
     return true;
 }
 
-// Post-conditions:
-// - _cursorIdx (which is a logical index) remains unchanged
-// - gapBuffer.GetGapBegin() == MapLogicalIndexToBufferIndex(_cursorIdx)
-void MoveGapToCursor(TextEdit& te) {
-    MoveGapToLogicalIndex(te._tb->gapBuffer, te._cursorIdx);
+// Replaces the selection if there is one. The gap absorbs the selected range and then takes the new text (see EraseRange()), so the selected
+// text is never copied around, no matter how large.
+void InsertAtCursor(TextEdit& te, const ImWchar* text, size_t size) {
+    int64_t begin = te.GetSelectionBegin();
+    te._tb->Replace(begin, te.GetSelectionEnd() - begin, text, size);
+    te._cursorIdx = begin + (int64_t)size;
+    te._anchorIdx = te._cursorIdx;
 }
 
-void InsertAtCursor(TextEdit& te, const ImWchar* text, size_t size) {
+// Erase the selection if there is one, otherwise `count` chars before (negative) or after (positive) the cursor.
+// Returns whether anything was erased.
+bool EraseAtCursor(TextEdit& te, int64_t count) {
+    int64_t begin, end;
     if (te.HasSelection()) {
-        // TODO handle replacement of selection
+        begin = te.GetSelectionBegin();
+        end = te.GetSelectionEnd();
     } else {
-        MoveGapToCursor(te);
-        InsertAtGap(te._tb->gapBuffer, text, size);
-        te._cursorIdx += size;
-        te._anchorIdx = te._cursorIdx;
+        begin = std::max<int64_t>(te._cursorIdx + std::min<int64_t>(count, 0), 0);
+        end = std::min(te._cursorIdx + std::max<int64_t>(count, 0), te._tb->gapBuffer.GetContentSize());
     }
+    if (begin == end) {
+        return false;
+    }
+
+    te._tb->Erase(begin, end - begin);
+    te._cursorIdx = begin;
+    te._anchorIdx = begin;
+    return true;
+}
+
+// Lay out the edited paragraphs right away, the cursor state must not be looked up in the GlyphRun's from before the edit
+void RefreshAfterEdit(TextEdit& te, float visibleBegin, float visibleEnd) {
+    te._tb->RefreshCaches();
+    RefreshTextEditCachedData(te, te._cachedViewportWidth, visibleBegin, visibleEnd);
+    RefreshCursorState(te);
 }
 } // namespace
 
@@ -498,10 +799,23 @@ void Ionl::TextEdit::Show() {
 
     auto contentRegionAvail = ImGui::GetContentRegionAvail();
 
+    // Visible area of the window in text canvas space, plus a margin of one clip rect height above and below to make scrolling smooth
+    float clipHeight = window->ClipRect.GetHeight();
+    float visibleBegin = window->ClipRect.Min.y - window->DC.CursorPos.y - clipHeight;
+    float visibleEnd = window->ClipRect.Max.y - window->DC.CursorPos.y + clipHeight;
+
+    // The TextBuffer may have been edited by someone else since the last frame (e.g. ReplaceInNotebook()), leaving the cursor anywhere
+    bool isCursorStale = _cachedDataVersion != _tb->cacheDataVersion;
+
     // Performs text layout if necessary
     // -> updates _cachedGlyphRuns
     // -> updates _cachedContentHeight
-    RefreshTextEditCachedData(*this, contentRegionAvail.x);
+    RefreshTextEditCachedData(*this, contentRegionAvail.x, visibleBegin, visibleEnd);
+    if (isCursorStale && !_cachedGlyphRuns.empty()) {
+        _cursorIdx = std::min(_cursorIdx, _tb->gapBuffer.GetContentSize());
+        _anchorIdx = std::min(_anchorIdx, _tb->gapBuffer.GetContentSize());
+        RefreshCursorState(*this);
+    }
 
     ImVec2 widgetSize(contentRegionAvail.x, _cachedContentHeight);
     ImRect bb{ window->DC.CursorPos, window->DC.CursorPos + widgetSize };
@@ -546,6 +860,8 @@ void Ionl::TextEdit::Show() {
         // ImGui::SetKeyOwner(ImGuiKey_NavGamepadCancel, _id);
         ImGui::SetKeyOwner(ImGuiKey_Home, _id);
         ImGui::SetKeyOwner(ImGuiKey_End, _id);
+        ImGui::SetKeyOwner(ImGuiKey_PageUp, _id);
+        ImGui::SetKeyOwner(ImGuiKey_PageDown, _id);
     }
 
     int64_t bufContentSize = _tb->gapBuffer.GetContentSize();
@@ -625,14 +941,46 @@ void Ionl::TextEdit::Show() {
 
             RefreshCursorState(*this);
             _cursorAnimTimer = 0.0f;
-        } else if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
-            // TODO
-        } else if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) {
-            // TODO
-        } else if (ImGui::IsKeyPressed(ImGuiKey_Delete)) {
-            // TODO
-        } else if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) {
-            // TODO
+        } else if (ImGui::IsKeyPressed(ImGuiKey_UpArrow) || ImGui::IsKeyPressed(ImGuiKey_DownArrow) ||
+                   ImGui::IsKeyPressed(ImGuiKey_PageUp) || ImGui::IsKeyPressed(ImGuiKey_PageDown))
+        {
+            // Move to the same horizontal offset on the target line, by hit testing it the same way as a mouse click
+            float targetY;
+            if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) {
+                targetY = _cursorVisualOffset.y - clipHeight;
+            } else if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) {
+                targetY = _cursorVisualOffset.y + clipHeight;
+            } else {
+                size_t starting = _cursorIsAtWrapPoint && _cursorAffinity == CursorAffinity::Upstream
+                    ? _cursorCurrGlyphRun - 1
+                    : _cursorCurrGlyphRun;
+                auto [lineBegin, lineEnd] = FindLineRange(_cachedGlyphRuns, starting);
+                if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
+                    // Moving up from the first line places the cursor at the beginning of document
+                    targetY = lineBegin > 0 ? _cachedGlyphRuns[lineBegin - 1].pos.y : -std::numeric_limits<float>::max();
+                } else {
+                    targetY = lineEnd < _cachedGlyphRuns.size() ? _cachedGlyphRuns[lineEnd].pos.y : std::numeric_limits<float>::max();
+                }
+            }
+
+            if (targetY < 0.0f) {
+                _cursorIdx = 0;
+                _cursorAffinity = CursorAffinity::Downstream;
+            } else {
+                auto [idx, affinity] = CalcCursorStateFromMouse(*this, _cursorVisualOffset.x, targetY);
+                _cursorIdx = MapBufferIndexToLogicalIndex(_tb->gapBuffer, idx);
+                _cursorAffinity = affinity;
+            }
+            if (!io.KeyShift) _anchorIdx = _cursorIdx;
+
+            RefreshCursorState(*this);
+            _cursorAnimTimer = 0.0f;
+        } else if (ImGui::IsKeyPressed(ImGuiKey_Delete) || ImGui::IsKeyPressed(ImGuiKey_Backspace)) {
+            int64_t count = ImGui::IsKeyPressed(ImGuiKey_Delete) ? +1 : -1;
+            if (EraseAtCursor(*this, count)) {
+                RefreshAfterEdit(*this, visibleBegin, visibleEnd);
+                _cursorAnimTimer = 0.0f;
+            }
         } else if (ImGui::IsKeyPressed(ImGuiKey_Enter)) {
             // TODO
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_X)) {
@@ -643,16 +991,32 @@ void Ionl::TextEdit::Show() {
             // TODO
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_V)) {
             // Paste
-            // TODO
-        } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_Z)) {
-            // Undo
-            // TODO
-        } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_Y)) {
-            // Redo
-            // TODO
+            // The clipboard is decoded straight into the gap, and only the paragraphs around it get reparsed by RefreshCaches()
+            if (const char* clipboard = ImGui::GetClipboardText(); clipboard && *clipboard != '\0') {
+                int64_t begin = GetSelectionBegin();
+                int64_t size = _tb->Paste(begin, GetSelectionEnd() - begin, clipboard);
+                _cursorIdx = begin + size;
+                _anchorIdx = _cursorIdx;
+
+                RefreshAfterEdit(*this, visibleBegin, visibleEnd);
+                _cursorAnimTimer = 0.0f;
+            }
+        } else if (isShortcutKey && (ImGui::IsKeyPressed(ImGuiKey_Z) || ImGui::IsKeyPressed(ImGuiKey_Y))) {
+            // Undo, redo
+            int64_t idx = ImGui::IsKeyPressed(ImGuiKey_Z) ? _tb->Undo() : _tb->Redo();
+            if (idx != -1) {
+                _cursorIdx = idx;
+                _anchorIdx = idx;
+
+                RefreshAfterEdit(*this, visibleBegin, visibleEnd);
+                _cursorAnimTimer = 0.0f;
+            }
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_A)) {
             // Select all
-            // TODO
+            _anchorIdx = 0;
+            _cursorIdx = bufContentSize;
+            RefreshCursorState(*this);
+            _cursorAnimTimer = 0.0f;
         }
 
         float mouseX = io.MousePos.x - bb.Min.x;
@@ -673,17 +1037,21 @@ void Ionl::TextEdit::Show() {
             // TODO imgui checks "input_requested_by_nav", is that necessary?
             bool ignoreCharInputs = (io.KeyCtrl && !io.KeyAlt) || (isOSX && io.KeySuper);
             if (!ignoreCharInputs) {
-                for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
-                    ImWchar c = io.InputQueueCharacters[i];
+                // Compact the accepted chars in place and insert them all at once, so that a burst (e.g. a string committed by an IME) costs a
+                // single gap move, widen and cache refresh instead of one per char
+                auto& queue = io.InputQueueCharacters;
+                int numChars = 0;
+                for (int i = 0; i < queue.Size; ++i) {
+                    ImWchar c = queue[i];
                     if (FilterInputCharacter(c))
                         continue;
-                    InsertAtCursor(*this, &c, 1);
+                    queue[numChars++] = c;
                 }
-                io.InputQueueCharacters.resize(0);
-
-                // NOTE: this TextEdit's cache will be refreshed next frame
-                _tb->RefreshCaches();
-                RefreshCursorState(*this);
+                if (numChars > 0) {
+                    InsertAtCursor(*this, queue.Data, numChars);
+                    RefreshAfterEdit(*this, visibleBegin, visibleEnd);
+                }
+                queue.resize(0);
             }
         }
     }
@@ -692,23 +1060,61 @@ void Ionl::TextEdit::Show() {
 
     auto styleTextColor = ImGui::GetColorU32(ImGuiCol_Text);
     auto styleSelectionColor = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
+    auto styleSearchMatchColor = ImGui::GetColorU32(ImGuiCol_PlotHistogram, 0.35f);
+
+    // Only the GlyphRun's inside the visible range are drawn, which are the only ones laid out when virtualizing layout
+    auto drawBegin = std::partition_point(_cachedGlyphRuns.begin(), _cachedGlyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.pos.y < visibleBegin;
+    });
+    auto drawEnd = std::partition_point(drawBegin, _cachedGlyphRuns.end(), [&](const GlyphRun& gr) {
+        return gr.pos.y < visibleEnd;
+    });
+
+    // Draw search matches, unless GlyphRun's are behind the matches, i.e. the TextBuffer was edited after laying out
+    if (_tb->matchIndex.IsActive() && _cachedDataVersion == _tb->cacheDataVersion && drawBegin != drawEnd) {
+        auto& buf = _tb->gapBuffer;
+        auto visibleMatches = _tb->matchIndex.FindOverlapping(
+            MapBufferIndexToLogicalIndex(buf, drawBegin->tr.begin),
+            MapBufferIndexToLogicalIndex(buf, std::prev(drawEnd)->tr.begin) + (std::prev(drawEnd)->tr.end - std::prev(drawEnd)->tr.begin));
+
+        auto matchIt = visibleMatches.begin();
+        for (auto& gr : std::span(drawBegin, drawEnd)) {
+            if (gr.isPlaceholder) {
+                continue;
+            }
+            // TextRun's never straddle the gap, so a GlyphRun is a contiguous logical range too
+            int64_t grBegin = MapBufferIndexToLogicalIndex(buf, gr.tr.begin);
+            int64_t grEnd = grBegin + (gr.tr.end - gr.tr.begin);
+            while (matchIt != visibleMatches.end() && matchIt->end <= grBegin) {
+                ++matchIt;
+            }
+            // A match may continue into the next GlyphRun, so only step past the ones ending in this one
+            for (auto it = matchIt; it != visibleMatches.end() && it->begin < grEnd; ++it) {
+                auto pMin = bb.Min + gr.pos;
+                pMin.x += CalcGlyphRunOffset(gr, gr.tr.begin + (std::max(it->begin, grBegin) - grBegin));
+                auto pMax = bb.Min + gr.pos;
+                pMax.x += CalcGlyphRunOffset(gr, gr.tr.begin + (std::min(it->end, grEnd) - grBegin));
+                pMax.y += gr.height;
+                drawList->AddRectFilled(pMin, pMax, styleSearchMatchColor);
+            }
+        }
+    }
 
     // Draw selection if one exists
     if (activeId == _id && _cursorIdx != _anchorIdx) {
-        // TODO possible optimization: start searching for selection end GlyphRun at whichever location is closer, _cursorCurrGlyphRun or end of document
-        auto selBegin = MapBufferIndexToLogicalIndex(_tb->gapBuffer, this->GetSelectionBegin());
-        auto selBeginGrIdx = FindGlyphRunContainingIndex(_cachedGlyphRuns, _cursorCurrGlyphRun, selBegin);
-        auto selEnd = MapBufferIndexToLogicalIndex(_tb->gapBuffer, this->GetSelectionEnd());
-        auto selEndGrIdx = FindGlyphRunContainingIndex(_cachedGlyphRuns, _cursorCurrGlyphRun, selEnd);
+        auto selBegin = MapLogicalIndexToBufferIndex(_tb->gapBuffer, this->GetSelectionBegin());
+        auto selBeginGrIdx = FindGlyphRunContainingIndex(_cachedGlyphRuns, selBegin);
+        auto selEnd = MapLogicalIndexToBufferIndex(_tb->gapBuffer, this->GetSelectionEnd());
+        auto selEndGrIdx = FindGlyphRunContainingIndex(_cachedGlyphRuns, selEnd);
 
         // Defensive: in case something goes wrong, we just show an error and skip drawing
         if (selBeginGrIdx != -1 && selEndGrIdx != -1) {
             if (selBeginGrIdx == selEndGrIdx) {
                 auto& gr = _cachedGlyphRuns[selBeginGrIdx];
                 auto pMin = bb.Min + gr.pos;
-                pMin.x += CalcSubTextRunDim(*_tb, gr.tr, gr.tr.begin, selBegin).x;
+                pMin.x += CalcGlyphRunOffset(gr, selBegin);
                 auto pMax = bb.Min + gr.pos;
-                pMax.x += gr.horizontalAdvance - CalcSubTextRunDim(*_tb, gr.tr, selEnd, gr.tr.end).x;
+                pMax.x += CalcGlyphRunOffset(gr, selEnd);
                 pMax.y += gr.height;
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
             } else {
@@ -717,7 +1123,7 @@ void Ionl::TextEdit::Show() {
                 // Draw selection for first GlyphRun
                 auto& selBeginGr = _cachedGlyphRuns[selBeginGrIdx];
                 pMin = bb.Min + selBeginGr.pos;
-                pMin.x += CalcSubTextRunDim(*_tb, selBeginGr.tr, selBeginGr.tr.begin, selBegin).x;
+                pMin.x += CalcGlyphRunOffset(selBeginGr, selBegin);
                 pMax = bb.Min + selBeginGr.pos + ImVec2(selBeginGr.horizontalAdvance, selBeginGr.height);
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
 
@@ -734,7 +1140,7 @@ void Ionl::TextEdit::Show() {
                 auto& selEndGr = _cachedGlyphRuns[selEndGrIdx];
                 pMin = bb.Min + selEndGr.pos;
                 pMax = bb.Min + selEndGr.pos;
-                pMax.x += CalcSubTextRunDim(*_tb, selEndGr.tr, selEndGr.tr.begin, selEnd).x;
+                pMax.x += CalcGlyphRunOffset(selEndGr, selEnd);
                 pMax.y += selEndGr.height;
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
             }
@@ -748,7 +1154,11 @@ void Ionl::TextEdit::Show() {
     }
 
     // Draw text
-    for (auto& glyphRun : _cachedGlyphRuns) {
+    for (auto& glyphRun : std::span(drawBegin, drawEnd)) {
+        if (glyphRun.isPlaceholder) {
+            continue;
+        }
+
         auto& face = gMarkdownStylesheet.LookupFace(glyphRun.tr.style);
 
         auto absPos = bb.Min + glyphRun.pos;
@@ -798,6 +1208,12 @@ void Ionl::TextEdit::Show() {
         for (auto& glyphRun : _cachedGlyphRuns) {
             auto& face = gMarkdownStylesheet.LookupFace(glyphRun.tr.style);
             auto absPos = bb.Min + glyphRun.pos;
+            if (glyphRun.isPlaceholder) {
+                if (glyphRun.height > 0.0f) {
+                    dl->AddRect(absPos, ImVec2(bb.Max.x, absPos.y + glyphRun.height), IM_COL32(0, 255, 255, 255));
+                }
+                continue;
+            }
             dl->AddRect(absPos, ImVec2(absPos.x + glyphRun.horizontalAdvance, absPos.y + face.font->FontSize), IM_COL32(255, 0, 255, 255));
         }
     }
@@ -812,6 +1228,10 @@ void Ionl::TextEdit::Show() {
     ImGui::Begin("dbg: TextEdit");
     {
         ImGui::Checkbox("Show bounding boxes", &_debugShowBoundingBoxes);
+        if (ImGui::Checkbox("Virtualize layout of small buffers too", &_debugForceVirtualizeLayout)) {
+            _cachedDataVersion = 0;
+        }
+        ImGui::Text("_virtualizeLayout = %s", StringifyBool(_virtualizeLayout));
 
         ImGui::Text("_cursorIdx = %zu", _cursorIdx);
         ImGui::Text("_anchorIdx = %zu", _anchorIdx);
@@ -872,6 +1292,16 @@ void Ionl::TextEdit::Show() {
             ImGui::End();
         }
 
+        bool searchChanged = ImGui::InputText("Search", _debugSearchText, sizeof(_debugSearchText));
+        searchChanged |= ImGui::Checkbox("Case-insensitive", &_debugSearchCaseInsensitive);
+        if (searchChanged) {
+            ImWchar needle[sizeof(_debugSearchText)];
+            auto needleEnd = _debugSearchText + strlen(_debugSearchText);
+            auto needleSize = TranscodeUtf8ToImWchar(_debugSearchText, needleEnd, needle);
+            _tb->SetSearch(TextSearcher(std::span(needle, needleSize), { .caseInsensitive = _debugSearchCaseInsensitive }));
+        }
+        ImGui::Text("Search matches: %zu", _tb->matchIndex.GetMatches().size());
+
         if (ImGui::Button("Dump GapBuffer contents to stdout")) {
             DumpGapBuffer(_tb->gapBuffer, std::cout);
         }
@@ -6,6 +6,7 @@
 
 #include <ionl/gap_buffer.hpp>
 #include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
 #include <imgui/imgui.h>
 
 #include <string>
@@ -24,9 +25,15 @@ struct GlyphRun {
     ImVec2 pos;
     float horizontalAdvance = 0.0f; // == <used MarkdownStylesheet>.LookupFace(this->tr.style).CalcTextSize(... contents of this GlyphRun ...)
     float height = 0.0f; // == <used MarkdownStylesheet>.LookupFace(this->tr.style).FontSize
+    // Cumulative advances of the glyphs, i.e. prefixAdvances[i] is the width of the first i+1 glyphs in this run.
+    // Used for mapping between buffer indices and horizontal offsets with binary search instead of re-measuring text.
+    std::vector<float> prefixAdvances;
 
     // Whether this TextRun is on a new line, created by soft wrapping
     bool isSoftWrapped = false;
+    // Whether this is a placeholder for a paragraph that is not laid out yet, see TextEdit::_virtualizeLayout.
+    // A placeholder paragraph has one GlyphRun per TextRun all placed at its top left corner, the first of which has the estimated height of the paragraph and the rest 0.
+    bool isPlaceholder = false;
 };
 
 enum class CursorAffinity {
@@ -38,6 +45,9 @@ enum class CursorAffinity {
 /// - Spans from ImGui::GetCursorPos().x, all the way to the right at max content width
 /// - Height depends on the text inside
 struct TextEdit {
+    // Buffers of at least this many chars get `_virtualizeLayout`, it is turned off again below half of this
+    static constexpr int64_t kVirtualizeLayoutThreshold = 256 * 1024;
+
     TextBuffer* _tb;
     std::vector<GlyphRun> _cachedGlyphRuns;
 
@@ -76,6 +86,9 @@ struct TextEdit {
     float _cursorAnimTimer = 0.0f;
 
     ImGuiID _id;
+    // If true, only the paragraphs around the visible area of the window are laid out. The others are given an estimated height,
+    // and laid out lazily as they are scrolled into view. Set by the size of the buffer, see kVirtualizeLayoutThreshold.
+    bool _virtualizeLayout = false;
     float _cachedContentHeight = 0.0f;
     float _cachedViewportWidth = 0.0f;
     int _cachedDataVersion = 0;
@@ -88,9 +101,12 @@ struct TextEdit {
     int _debugMoveGapDelta = 0;
     int _debugDesiredGapSize = 64;
     bool _debugShowBoundingBoxes = false;
+    bool _debugForceVirtualizeLayout = false;
     bool _debugShowGapBufferDump = false;
     bool _debugShowTextRuns = false;
     bool _debugShowGlyphRuns = false;
+    char _debugSearchText[128] = {};
+    bool _debugSearchCaseInsensitive = false;
 #endif
 
     TextEdit(ImGuiID id, TextBuffer& textBuffer);
@@ -0,0 +1,54 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+Ionl::WorkerPool::WorkerPool(int numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+    }
+
+    mThreads.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back([this]() { RunWorker(); });
+    }
+}
+
+Ionl::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mMutex);
+        mStopping = true;
+    }
+    mTaskAvailable.notify_all();
+
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void Ionl::WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(mMutex);
+        mTasks.push_back(std::move(task));
+    }
+    mTaskAvailable.notify_one();
+}
+
+void Ionl::WorkerPool::RunWorker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mMutex);
+            mTaskAvailable.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+            // Drain the queue even when stopping, so that whoever submitted a task can rely on it being run
+            if (mTasks.empty()) {
+                return;
+            }
+
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+        }
+
+        task();
+    }
+}
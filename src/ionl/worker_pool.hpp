@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Ionl {
+
+// A fixed set of background threads running submitted tasks in FIFO order.
+class WorkerPool {
+private:
+    std::vector<std::thread> mThreads;
+    std::deque<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mTaskAvailable;
+    bool mStopping = false;
+
+public:
+    // If `numThreads` is 0, one less than the number of hardware threads is used (leaving one for the UI thread), but at least 1.
+    explicit WorkerPool(int numThreads = 0);
+    // Finishes all submitted tasks before returning.
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int GetThreadCount() const { return (int)mThreads.size(); }
+
+    void Submit(std::function<void()> task);
+
+private:
+    void RunWorker();
+};
+
+} // namespace Ionl
@@ -0,0 +1,219 @@
+#include "testing.hpp"
+
+#include <ionl/gap_buffer.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string_view>
+#include <vector>
+
+using namespace Ionl;
+using namespace Ionl::Testing;
+
+namespace {
+void CheckInvariants(const GapBuffer& buf, const std::vector<ImWchar>& expected) {
+    IONL_CHECK(buf.frontSize >= 0 && buf.gapSize >= 0);
+    IONL_CHECK(buf.frontSize + buf.gapSize <= buf.bufferSize);
+    IONL_CHECK(buf.GetContentSize() == (int64_t)expected.size());
+    IONL_CHECK(ExtractChars(buf) == expected);
+
+    // Every line lookup agrees with counting '\n' in the expected content
+    int64_t numNewlines = 0;
+    for (int64_t i = 0; i <= (int64_t)expected.size(); i += 97) {
+        auto n = std::count(expected.begin(), expected.begin() + i, '\n');
+        IONL_CHECK(MapLogicalIndexToLine(buf, i) == n);
+    }
+    for (int64_t i = 0; i < (int64_t)expected.size(); ++i) {
+        if (expected[i] == '\n') {
+            numNewlines += 1;
+            IONL_CHECK(MapLineToLogicalIndex(buf, numNewlines) == i + 1);
+        }
+    }
+    IONL_CHECK(MapLineToLogicalIndex(buf, numNewlines + 1) == -1);
+    IONL_CHECK(CountLines(buf) == numNewlines + 1);
+}
+
+// Random edits through every GapBuffer editing function, checked against the same edits on a std::vector
+void RunRandomEdits(std::string_view initialContent, int numSteps, uint32_t seed) {
+    std::mt19937 rng(seed);
+    GapBuffer buf(initialContent);
+    std::vector<ImWchar> expected(initialContent.begin(), initialContent.end());
+    CheckInvariants(buf, expected);
+
+    constexpr std::string_view kAlphabet = "abc \n\n*_`";
+    for (int step = 0; step < numSteps; ++step) {
+        auto size = (int64_t)expected.size();
+        auto randomIdx = [&]() { return (int64_t)(rng() % (size + 1)); };
+        switch (rng() % 6) {
+            case 0: {
+                std::vector<ImWchar> text(rng() % 300);
+                for (auto& c : text) {
+                    c = kAlphabet[rng() % kAlphabet.size()];
+                }
+                int64_t idx = randomIdx();
+                MoveGapToLogicalIndex(buf, idx);
+                InsertAtGap(buf, text.data(), text.size());
+                expected.insert(expected.begin() + idx, text.begin(), text.end());
+            } break;
+            case 1: {
+                int64_t idx = randomIdx();
+                int64_t count = std::min<int64_t>(rng() % 400, size - idx);
+                MoveGapToLogicalIndex(buf, idx);
+                EraseAfterGap(buf, count);
+                expected.erase(expected.begin() + idx, expected.begin() + idx + count);
+            } break;
+            case 2: {
+                int64_t idx = randomIdx();
+                int64_t count = std::min<int64_t>(rng() % 400, idx);
+                MoveGapToLogicalIndex(buf, idx);
+                EraseBeforeGap(buf, count);
+                expected.erase(expected.begin() + idx - count, expected.begin() + idx);
+            } break;
+            case 3: {
+                // The gap is left wherever it is, EraseRange() decides how to get there
+                int64_t begin = randomIdx();
+                int64_t end = std::min<int64_t>(begin + rng() % 2000, size);
+                EraseRange(buf, begin, end);
+                IONL_CHECK(buf.frontSize == begin);
+                expected.erase(expected.begin() + begin, expected.begin() + end);
+            } break;
+            case 4: {
+                WidenGap(buf, rng() % 1000);
+            } break;
+            case 5: {
+                ShrinkToFit(buf, rng() % 16);
+            } break;
+        }
+        CheckInvariants(buf, expected);
+    }
+}
+
+// Apply `edits` one by one from the back, where indices into the original content are still valid
+std::vector<ImWchar> ApplyEditsNaively(std::vector<ImWchar> content, std::vector<GapBufferEdit> edits) {
+    std::stable_sort(edits.begin(), edits.end(), [](const GapBufferEdit& a, const GapBufferEdit& b) {
+        return a.idx != b.idx ? a.idx < b.idx : (a.removedSize == 0 && b.removedSize != 0);
+    });
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        content.erase(content.begin() + it->idx, content.begin() + it->idx + it->removedSize);
+        content.insert(content.begin() + it->idx, it->text.begin(), it->text.end());
+    }
+    return content;
+}
+} // namespace
+
+IONL_TEST(gap_buffer, random_edits_small) {
+    // Below LineIndex::kMinIndexedSize for most of the run, so lines are found by scanning
+    RunRandomEdits("hello\nworld", 300, 1);
+}
+
+IONL_TEST(gap_buffer, random_edits_indexed) {
+    std::string content;
+    while (content.size() < 20000) {
+        content += "lorem ipsum dolor\n";
+    }
+    RunRandomEdits(content, 300, 2);
+}
+
+IONL_TEST(gap_buffer, segments_around_gap) {
+    GapBuffer buf("0123456789");
+    MoveGapToLogicalIndex(buf, 4);
+    WidenGap(buf, 8);
+
+    auto [front, back] = buf.Segments(2, 7);
+    IONL_CHECK(std::u16string_view((const char16_t*)front.data(), front.size()) == u"23");
+    IONL_CHECK(std::u16string_view((const char16_t*)back.data(), back.size()) == u"456");
+    IONL_CHECK(buf.Segments(5, 7)[0].empty());
+    IONL_CHECK(buf.Segments(0, 3)[1].empty());
+}
+
+IONL_TEST(gap_buffer, apply_edits_ordering) {
+    GapBuffer buf("0123456789abcdef");
+    auto expected = ExtractChars(buf);
+    std::vector<ImWchar> x{ 'X' }, yy{ 'Y', 'Y' }, z{ 'Z' };
+    // Out of order, with an insertion at the same index as a removal, and one at the very end
+    std::vector<GapBufferEdit> edits{
+        { .idx = 10, .removedSize = 3, .text = yy },
+        { .idx = 2, .removedSize = 0, .text = x },
+        { .idx = 16, .removedSize = 0, .text = z },
+        { .idx = 2, .removedSize = 2, .text = {} },
+        { .idx = 10, .removedSize = 0, .text = x },
+    };
+    ApplyEdits(buf, edits);
+
+    auto result = ExtractChars(buf);
+    IONL_CHECK(result == ApplyEditsNaively(expected, edits));
+    IONL_CHECK(std::u16string_view((const char16_t*)result.data(), result.size()) == u"01X456789XYYdefZ");
+    // The gap ends up right after the last edit
+    IONL_CHECK(buf.frontSize == (int64_t)result.size());
+}
+
+IONL_TEST(gap_buffer, apply_edits_random) {
+    std::mt19937 rng(3);
+    std::string content;
+    while (content.size() < 5000) {
+        content += "some text\n";
+    }
+    GapBuffer buf(content);
+    auto expected = ExtractChars(buf);
+    std::vector<ImWchar> texts[] = { {}, { 'a' }, { 'b', 'b', 'b' }, std::vector<ImWchar>(100, 'c') };
+    for (int round = 0; round < 50; ++round) {
+        // Non-overlapping removals at increasing indices, then shuffled; about as much is removed as inserted so the content stays the same size
+        std::vector<GapBufferEdit> edits;
+        int64_t idx = rng() % 50;
+        while (idx < (int64_t)expected.size()) {
+            int64_t removedSize = std::min<int64_t>(rng() % 60, expected.size() - idx);
+            edits.push_back({ .idx = idx, .removedSize = removedSize, .text = texts[rng() % std::size(texts)] });
+            idx += removedSize + rng() % 300;
+        }
+        std::shuffle(edits.begin(), edits.end(), rng);
+        MoveGapToLogicalIndex(buf, rng() % (expected.size() + 1));
+
+        ApplyEdits(buf, edits);
+        expected = ApplyEditsNaively(std::move(expected), edits);
+        CheckInvariants(buf, expected);
+    }
+}
+
+IONL_TEST(gap_buffer, cjk_content_is_sized_by_chars) {
+    std::string content;
+    while (content.size() < 30000) {
+        content += "中文内容，";
+    }
+    int64_t numChars = (int64_t)content.size() / 3;
+
+    GapBuffer buf(content);
+    IONL_CHECK(buf.GetContentSize() == numChars);
+    IONL_CHECK(buf.GetGapSize() < numChars / 8);
+
+    MoveGapToLogicalIndex(buf, 0);
+    InsertAtGap(buf, content.data(), content.size());
+    IONL_CHECK(buf.GetContentSize() == numChars * 2);
+    // Grown to fit the decoded chars; fitting the UTF-8 bytes would have needed 1 + 3 times the previous content
+    IONL_CHECK(buf.bufferSize < numChars * 4);
+}
+
+IONL_TEST(gap_buffer, growth_of_large_buffers) {
+    auto oldPolicy = gGapBufferGrowthPolicy;
+    gGapBufferGrowthPolicy.doublingLimit = INT64_MAX;
+    // Sizes past 2^31 elements still double instead of wrapping around
+    int64_t size = int64_t(1) << 33;
+    IONL_CHECK(CalcGrownBufferSize(size + 1, size + 2) == size * 2);
+    gGapBufferGrowthPolicy = oldPolicy;
+
+    IONL_CHECK(CalcGrownBufferSize(0, 5) == 8);
+    IONL_CHECK(CalcGrownBufferSize(100, 300) == 512);
+}
+
+IONL_TEST(gap_buffer, snapshot_is_unaffected_by_edits) {
+    GapBuffer buf("shared content");
+    GapBufferSnapshot snapshot(buf);
+    auto before = ExtractChars(*snapshot);
+
+    ImWchar text[] = { '!' };
+    MoveGapToLogicalIndex(buf, 6);
+    InsertAtGap(buf, text, 1);
+    EraseRange(buf, 0, 3);
+
+    IONL_CHECK(ExtractChars(*snapshot) == before);
+    IONL_CHECK(buf.ExtractContent() == "red! content");
+}
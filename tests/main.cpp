@@ -0,0 +1,56 @@
+#include "testing.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct TestCase {
+    const char* name;
+    Ionl::Testing::TestFunc func;
+};
+
+// Function local, so that it exists before the TestRegistration's in other translation units get constructed
+std::vector<TestCase>& GetTestCases() {
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+} // namespace
+
+Ionl::Testing::TestRegistration::TestRegistration(const char* name, TestFunc func) {
+    GetTestCases().push_back(TestCase{ .name = name, .func = func });
+}
+
+void Ionl::Testing::FailCheck(const char* file, int line, const char* expr) {
+    throw std::runtime_error(std::string(file) + ":" + std::to_string(line) + ": check failed: " + expr);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    int numRun = 0;
+    int numFailed = 0;
+    for (auto& testCase : GetTestCases()) {
+        if (std::strncmp(testCase.name, filter, std::strlen(filter)) != 0) {
+            continue;
+        }
+
+        numRun += 1;
+        auto begin = std::chrono::steady_clock::now();
+        try {
+            testCase.func();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            std::printf("[  OK  ] %s (%.1f ms)\n", testCase.name, ms);
+        } catch (const std::exception& e) {
+            numFailed += 1;
+            std::printf("[ FAIL ] %s\n    %s\n", testCase.name, e.what());
+        }
+    }
+
+    std::printf("%d of %d tests passed\n", numRun - numFailed, numRun);
+    // Also fail if the filter matched nothing, e.g. because of a typo in CMakeLists.txt
+    return numRun > 0 && numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#include "testing.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Ionl;
+using namespace Ionl::Testing;
+
+namespace {
+bool AreTextRunsEqual(const std::vector<TextRun>& a, const std::vector<TextRun>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const TextRun& x, const TextRun& y) {
+        return x.begin == y.begin && x.end == y.end && x.style == y.style && x.hasParagraphBreak == y.hasParagraphBreak;
+    });
+}
+
+std::vector<TextRun> ParseFully(const GapBuffer& buf) {
+    MdParser parser;
+    std::vector<TextRun> textRuns;
+    parser.Parse({ .src = &buf }, textRuns);
+    return textRuns;
+}
+
+// Random snippets of markdown, including ones that open and close code blocks
+std::vector<ImWchar> GenerateSnippet(std::mt19937& rng) {
+    constexpr std::string_view kSnippets[] = {
+        "word ", "**", "_", "__", "~~", "`", "\n", "\n\n", "# ", "## ", "```\n", "\n```\n", "\\*", "lorem ipsum ",
+    };
+    std::vector<ImWchar> result;
+    for (int n = rng() % 4 + 1; n > 0; --n) {
+        auto snippet = kSnippets[rng() % std::size(kSnippets)];
+        result.insert(result.end(), snippet.begin(), snippet.end());
+    }
+    return result;
+}
+
+// Best of a few parses of `content`, in seconds
+double TimeParse(std::string_view content) {
+    GapBuffer buf(content);
+    MdParser parser;
+    std::vector<TextRun> textRuns;
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < 5; ++i) {
+        textRuns.clear();
+        auto begin = std::chrono::steady_clock::now();
+        parser.Parse({ .src = &buf }, textRuns);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    IONL_CHECK(!textRuns.empty());
+    return best;
+}
+} // namespace
+
+IONL_TEST(markdown, incremental_reparse_matches_full_parse) {
+    std::mt19937 rng(4);
+    std::string content;
+    while (content.size() < 8000) {
+        content += "Some **bold** and _italic_ text\n# Heading\n`code` here\n";
+    }
+    TextBuffer tb(GapBuffer{ content });
+
+    for (int step = 0; step < 500; ++step) {
+        // A few edits between refreshes, so that the dirty range covers more than one edit
+        for (int n = rng() % 3 + 1; n > 0; --n) {
+            auto size = tb.gapBuffer.GetContentSize();
+            int64_t idx = rng() % (size + 1);
+            if (rng() % 2 == 0) {
+                auto text = GenerateSnippet(rng);
+                tb.Insert(idx, text.data(), text.size());
+            } else {
+                tb.Erase(idx, std::min<int64_t>(rng() % 30, size - idx));
+            }
+        }
+        tb.RefreshCaches();
+        IONL_CHECK(AreTextRunsEqual(tb.textRuns, ParseFully(tb.gapBuffer)));
+    }
+}
+
+IONL_TEST(markdown, code_fence_edit_reparses_rest) {
+    TextBuffer tb(GapBuffer("a **b**\n\ncode\n**c**\n"));
+    ImWchar fence[] = { '`', '`', '`', '\n' };
+    tb.Insert(0, fence, std::size(fence));
+    tb.RefreshCaches();
+    IONL_CHECK(AreTextRunsEqual(tb.textRuns, ParseFully(tb.gapBuffer)));
+    for (auto& tr : tb.textRuns) {
+        IONL_CHECK(tr.style.type == TextStyleType::CodeBlock);
+    }
+
+    tb.Erase(0, std::size(fence));
+    tb.RefreshCaches();
+    IONL_CHECK(AreTextRunsEqual(tb.textRuns, ParseFully(tb.gapBuffer)));
+    IONL_CHECK(tb.textRuns.front().style.type == TextStyleType::Regular);
+}
+
+IONL_TEST(markdown, pathological_delimiters_parse_in_linear_time) {
+    // Single paragraphs of delimiters that mostly never pair, or keep discarding each other
+    constexpr std::string_view kPatterns[] = {
+        "* ", "_ ", "` ", "* _ __ ~~ ** ` x ", "**__*_~~`", "`*_ **__~~ ", "\\*\\_\\`\\\\", "#",
+    };
+    for (auto pattern : kPatterns) {
+        auto timeRepeated = [&](int n) {
+            std::string content;
+            for (int i = 0; i < n; ++i) {
+                content += pattern;
+            }
+            return TimeParse(content);
+        };
+        double small = timeRepeated(10'000);
+        double large = timeRepeated(100'000);
+        // 10x the delimiters should take about 10x as long, quadratic pairing would take 100x
+        IONL_CHECK(large < small * 30 + 0.001);
+    }
+}
+
+#if IONL_DEBUG_FEATURES
+IONL_TEST(markdown, control_char_scan_matches_per_char_parse) {
+    std::mt19937 rng(5);
+    std::vector<ImWchar> content;
+    while (content.size() < 20000) {
+        auto snippet = GenerateSnippet(rng);
+        content.insert(content.end(), snippet.begin(), snippet.end());
+    }
+    GapBuffer buf;
+    InsertAtGap(buf, content.data(), content.size());
+    // The gap splits the content somewhere in the middle of a run
+    MoveGapToLogicalIndex(buf, content.size() / 2 + 3);
+
+    MdParser parser;
+    std::vector<TextRun> scanned, perChar;
+    parser.Parse({ .src = &buf }, scanned);
+    parser.Parse({ .src = &buf, .debugDisableControlCharScan = true }, perChar);
+    IONL_CHECK(AreTextRunsEqual(scanned, perChar));
+}
+#endif
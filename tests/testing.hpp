@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/macros.hpp>
+#include <imgui/imgui.h>
+
+#include <vector>
+
+namespace Ionl::Testing {
+
+using TestFunc = void (*)();
+
+struct TestRegistration {
+    TestRegistration(const char* name, TestFunc func);
+};
+
+[[noreturn]] void FailCheck(const char* file, int line, const char* expr);
+
+// Content of `buf` in logical order, for comparing against a plain array doing the same edits
+inline std::vector<ImWchar> ExtractChars(const GapBuffer& buf) {
+    std::vector<ImWchar> result;
+    for (auto segment : buf.Segments()) {
+        result.insert(result.end(), segment.begin(), segment.end());
+    }
+    return result;
+}
+
+} // namespace Ionl::Testing
+
+// Define a test named "suite.name". IonlTests runs all tests whose name starts with its first argument, or all of them without one.
+#define IONL_TEST(suite, name) \
+    static void CONCAT_4(Test_, suite, _, name)(); \
+    static Ionl::Testing::TestRegistration CONCAT_4(gTest_, suite, _, name)(#suite "." #name, &CONCAT_4(Test_, suite, _, name)); \
+    static void CONCAT_4(Test_, suite, _, name)()
+
+// Fail the current test if `expr` is false. Unlike assert(), this is checked in release builds too.
+#define IONL_CHECK(expr) \
+    do { \
+        if (!(expr)) Ionl::Testing::FailCheck(__FILE__, __LINE__, #expr); \
+    } while (0)
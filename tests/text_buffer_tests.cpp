@@ -0,0 +1,101 @@
+#include "testing.hpp"
+
+#include <ionl/edit_history.hpp>
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace Ionl;
+using namespace Ionl::Testing;
+
+IONL_TEST(text_buffer, select_all_delete_is_one_gap_move) {
+    constexpr int64_t kSize = 5 * 1024 * 1024;
+    TextBuffer tb(GapBuffer{ std::string(kSize, 'x') }, false);
+    MoveGapToLogicalIndex(tb.gapBuffer, kSize / 2);
+
+    auto counters = gGapBufferOpCounters;
+    tb.Erase(0, kSize);
+    IONL_CHECK(gGapBufferOpCounters.gapMoves - counters.gapMoves <= 1);
+    IONL_CHECK(gGapBufferOpCounters.widens == counters.widens);
+    IONL_CHECK(tb.gapBuffer.GetContentSize() == 0);
+    // Past the history memory limit, so it isn't copied out and can't be undone
+    IONL_CHECK(!tb.history.CanUndo());
+}
+
+IONL_TEST(text_buffer, replace_is_undone_in_one_step) {
+    TextBuffer tb(GapBuffer{ std::string_view("hello world") });
+    ImWchar text[] = { 'W', 'O', 'R', 'L', 'D', '!' };
+    tb.Replace(6, 5, text, std::size(text));
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == "hello WORLD!");
+
+    IONL_CHECK(tb.Undo() == 11);
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == "hello world");
+    IONL_CHECK(tb.Redo() == 12);
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == "hello WORLD!");
+}
+
+IONL_TEST(text_buffer, compact_expand_round_trip) {
+    TextBuffer tb(GapBuffer{ std::string_view("# Title\nsome **bold** text, 中文\n") });
+    ImWchar text[] = { '_', 'x', '_' };
+    tb.Insert(8, text, std::size(text));
+    tb.RefreshCaches();
+    auto content = tb.gapBuffer.ExtractContent();
+    int version = tb.cacheDataVersion;
+
+    tb.Compact();
+    IONL_CHECK(tb.isCompacted);
+    IONL_CHECK(tb.gapBuffer.bufferSize == 0);
+    IONL_CHECK(tb.textRuns.empty());
+    IONL_CHECK(tb.compactContent == content);
+    IONL_CHECK(tb.cacheDataVersion > version);
+    // Snapshots get storage of their own, without expanding
+    IONL_CHECK(tb.TakeSnapshot()->ExtractContent() == content);
+    IONL_CHECK(tb.isCompacted);
+
+    tb.Expand();
+    IONL_CHECK(!tb.isCompacted);
+    IONL_CHECK(tb.compactContent.empty());
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == content);
+    std::vector<TextRun> textRuns;
+    MdParser().Parse({ .src = &tb.gapBuffer }, textRuns);
+    IONL_CHECK(tb.textRuns.size() == textRuns.size());
+    for (size_t i = 0; i < textRuns.size(); ++i) {
+        IONL_CHECK(tb.textRuns[i].begin == textRuns[i].begin && tb.textRuns[i].end == textRuns[i].end);
+        IONL_CHECK(tb.textRuns[i].style == textRuns[i].style);
+    }
+
+    // Edits expand a compacted buffer on their own
+    tb.Compact();
+    tb.Erase(0, 2);
+    IONL_CHECK(!tb.isCompacted);
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == content.substr(2));
+}
+
+IONL_TEST(text_buffer, invalid_edits_are_rejected) {
+    TextBuffer tb(GapBuffer{ std::string_view("0123456789") });
+    ImWchar x[] = { 'x' };
+    auto check = [&](std::initializer_list<GapBufferEdit> edits) {
+        int version = tb.cacheDataVersion;
+        IONL_CHECK(!tb.ApplyEdits(std::span(edits.begin(), edits.end())));
+        IONL_CHECK(tb.gapBuffer.ExtractContent() == "0123456789");
+        IONL_CHECK(!tb.hasDirtyRange && tb.cacheDataVersion == version);
+        IONL_CHECK(!tb.history.CanUndo());
+    };
+    // Overlapping, in either order
+    check({ { .idx = 2, .removedSize = 3 }, { .idx = 4, .removedSize = 1, .text = x } });
+    check({ { .idx = 4, .removedSize = 1 }, { .idx = 2, .removedSize = 3 } });
+    // An insertion inside a removed range
+    check({ { .idx = 2, .removedSize = 3 }, { .idx = 3, .text = x } });
+    // Out of bounds
+    check({ { .idx = -1, .removedSize = 1 } });
+    check({ { .idx = 8, .removedSize = 3 } });
+    check({ { .idx = 11, .text = x } });
+    check({ { .idx = 2, .removedSize = -1 } });
+
+    // Touching edits are fine
+    IONL_CHECK(tb.ApplyEdits(std::initializer_list<GapBufferEdit>{ { .idx = 2, .removedSize = 3, .text = x }, { .idx = 5, .removedSize = 5 }, { .idx = 10, .text = x } }));
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == "01xx");
+}
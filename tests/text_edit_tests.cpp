@@ -0,0 +1,188 @@
+#include "testing.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/widget_text_edit.hpp>
+#include <imgui/imgui.h>
+#include <imgui/imgui_internal.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using namespace Ionl;
+
+namespace {
+// An ImGui context without a backend, with the default font for every markdown face
+class HeadlessImGui {
+private:
+    ImGuiContext* mContext;
+
+public:
+    HeadlessImGui() {
+        mContext = ImGui::CreateContext();
+        auto& io = ImGui::GetIO();
+        io.DisplaySize = ImVec2(1280.0f, 720.0f);
+        io.DeltaTime = 1.0f / 60.0f;
+        io.IniFilename = nullptr;
+        // Deliver all queued input in the next frame, like a burst committed by an IME
+        io.ConfigInputTrickleEventQueue = false;
+
+        auto font = io.Fonts->AddFontDefault();
+        unsigned char* pixels;
+        int width, height;
+        io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+        for (int i = 0; i < 8; ++i) {
+            gMarkdownStylesheet.SetRegularFace(MarkdownFace{ .font = font }, i & 1, i & 2, i & 4);
+        }
+        for (int level = 1; level <= kNumTitleLevels; ++level) {
+            gMarkdownStylesheet.SetHeadingFace(MarkdownFace{ .font = font }, level);
+        }
+    }
+
+    ~HeadlessImGui() {
+        gMarkdownStylesheet = MarkdownStylesheet();
+        ImGui::DestroyContext(mContext);
+    }
+
+    HeadlessImGui(const HeadlessImGui&) = delete;
+    HeadlessImGui& operator=(const HeadlessImGui&) = delete;
+
+    // Show `te` in a window covering the whole display
+    void ShowFrame(TextEdit& te) {
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+        ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+        ImGui::Begin("TextEdit test", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoSavedSettings);
+        te.Show();
+        ImGui::End();
+        ImGui::Render();
+    }
+
+    // Click into the first line of the TextEdit shown by ShowFrame(), which puts the cursor at the beginning of the content
+    void Focus(TextEdit& te) {
+        auto& io = ImGui::GetIO();
+        io.AddMousePosEvent(12.0f, 12.0f);
+        io.AddMouseButtonEvent(ImGuiMouseButton_Left, true);
+        ShowFrame(te);
+        io.AddMouseButtonEvent(ImGuiMouseButton_Left, false);
+        ShowFrame(te);
+    }
+
+    // Press and release `key` with the shortcut modifier held, over two frames
+    void PressShortcut(TextEdit& te, ImGuiKey key) {
+        auto& io = ImGui::GetIO();
+        io.AddKeyEvent(ImGuiMod_Ctrl, true);
+        io.AddKeyEvent(key, true);
+        ShowFrame(te);
+        io.AddKeyEvent(key, false);
+        io.AddKeyEvent(ImGuiMod_Ctrl, false);
+        ShowFrame(te);
+    }
+};
+
+// `size` bytes of prose, in paragraphs of about 600 bytes
+std::string GenerateProse(size_t size) {
+    std::string res;
+    for (int i = 0; res.size() < size; ++i) {
+        res += i % 40 == 39 ? "lorem ipsum\n" : "dolor sit amet ";
+    }
+    return res;
+}
+
+size_t CountLaidOutGlyphRuns(const TextEdit& te) {
+    size_t count = 0;
+    for (auto& gr : te._cachedGlyphRuns) {
+        if (!gr.isPlaceholder) ++count;
+    }
+    return count;
+}
+} // namespace
+
+IONL_TEST(text_edit, input_burst_is_one_edit) {
+    HeadlessImGui imgui;
+    TextBuffer tb(GapBuffer(GenerateProse(64 * 1024)));
+    TextEdit te(ImHashStr("TextEdit"), tb);
+    imgui.ShowFrame(te);
+    imgui.Focus(te);
+
+    constexpr int kBurstSize = 4096;
+    std::string burst;
+    for (int i = 0; i < kBurstSize; ++i) {
+        burst += (char)('a' + i % 26);
+    }
+    auto& io = ImGui::GetIO();
+    for (char c : burst) {
+        io.AddInputCharacter(c);
+    }
+
+    auto counters = gGapBufferOpCounters;
+    int version = tb.cacheDataVersion;
+    auto begin = std::chrono::steady_clock::now();
+    imgui.ShowFrame(te);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("    %d queued chars inserted in a %.2f ms frame\n", kBurstSize, ms);
+
+    IONL_CHECK(gGapBufferOpCounters.gapMoves - counters.gapMoves == 1);
+    IONL_CHECK(gGapBufferOpCounters.widens - counters.widens == 1);
+    IONL_CHECK(tb.cacheDataVersion - version == 1);
+    IONL_CHECK(tb.gapBuffer.ExtractContent().starts_with(burst));
+    IONL_CHECK(io.InputQueueCharacters.empty());
+}
+
+IONL_TEST(text_edit, large_buffers_virtualize_layout) {
+    HeadlessImGui imgui;
+    TextBuffer tb(GapBuffer(GenerateProse(4 * 1024 * 1024)));
+    TextEdit te(ImHashStr("TextEdit"), tb);
+    imgui.ShowFrame(te);
+
+    IONL_CHECK(te._virtualizeLayout);
+    IONL_CHECK(CountLaidOutGlyphRuns(te) < te._cachedGlyphRuns.size() / 20);
+}
+
+IONL_TEST(text_edit, paste_relays_before_placing_cursor) {
+    HeadlessImGui imgui;
+    TextBuffer tb(GapBuffer(GenerateProse(1024)));
+    TextEdit te(ImHashStr("TextEdit"), tb);
+    imgui.ShowFrame(te);
+    imgui.Focus(te);
+    IONL_CHECK(!te._virtualizeLayout);
+
+    // Lands the cursor at the end of a 4 MiB paste, which is far outside of the visible range
+    auto pasted = GenerateProse(4 * 1024 * 1024);
+    ImGui::SetClipboardText(pasted.c_str());
+    imgui.PressShortcut(te, ImGuiKey_V);
+
+    IONL_CHECK(te._virtualizeLayout);
+    IONL_CHECK(te._cursorIdx == (int64_t)pasted.size());
+    IONL_CHECK(CountLaidOutGlyphRuns(te) < te._cachedGlyphRuns.size() / 20);
+    auto& cursorGlyphRun = te._cachedGlyphRuns[te._cursorCurrGlyphRun];
+    IONL_CHECK(!cursorGlyphRun.isPlaceholder);
+    auto cursorBufIdx = MapLogicalIndexToBufferIndex(tb.gapBuffer, te._cursorIdx);
+    IONL_CHECK(cursorGlyphRun.tr.begin <= cursorBufIdx && cursorBufIdx <= cursorGlyphRun.tr.end);
+
+    // Back to below the threshold, everything gets laid out again
+    imgui.PressShortcut(te, ImGuiKey_Z);
+    IONL_CHECK(!te._virtualizeLayout);
+    IONL_CHECK(CountLaidOutGlyphRuns(te) == te._cachedGlyphRuns.size());
+    IONL_CHECK(tb.gapBuffer.ExtractContent() == GenerateProse(1024));
+}
+
+IONL_TEST(text_edit, cursor_follows_edits_made_elsewhere) {
+    HeadlessImGui imgui;
+    TextBuffer tb(GapBuffer(GenerateProse(4096)));
+    TextEdit te(ImHashStr("TextEdit"), tb);
+    imgui.ShowFrame(te);
+    te.SetCursor(tb.gapBuffer.GetContentSize());
+
+    // Like ReplaceInNotebook() on a loaded bullet, which doesn't know about any TextEdit's
+    tb.Erase(0, 4000);
+    tb.RefreshCaches();
+    imgui.ShowFrame(te);
+
+    IONL_CHECK(te._cursorIdx == tb.gapBuffer.GetContentSize());
+    IONL_CHECK(te._anchorIdx == te._cursorIdx);
+    IONL_CHECK(te._cursorCurrGlyphRun < te._cachedGlyphRuns.size());
+}
@@ -0,0 +1,113 @@
+#include "testing.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/text_search.hpp>
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Ionl;
+using namespace Ionl::Testing;
+
+namespace {
+std::vector<ImWchar> ToChars(std::string_view text) {
+    return std::vector<ImWchar>(text.begin(), text.end());
+}
+
+// Non-overlapping matches found left to right with std::search over the extracted content
+std::vector<TextSearchMatch> FindAllNaively(const GapBuffer& buf, const std::vector<ImWchar>& needle) {
+    auto content = ExtractChars(buf);
+    std::vector<TextSearchMatch> result;
+    auto it = content.begin();
+    while ((it = std::search(it, content.end(), needle.begin(), needle.end())) != content.end()) {
+        int64_t idx = it - content.begin();
+        result.push_back({ .begin = idx, .end = idx + (int64_t)needle.size() });
+        it += needle.size();
+    }
+    return result;
+}
+
+bool AreMatchesEqual(std::span<const TextSearchMatch> a, std::span<const TextSearchMatch> b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const TextSearchMatch& x, const TextSearchMatch& y) {
+        return x.begin == y.begin && x.end == y.end;
+    });
+}
+} // namespace
+
+IONL_TEST(text_search, match_straddling_gap) {
+    std::string content(1000, 'x');
+    content += "needle";
+    content += std::string(1000, 'x');
+    GapBuffer buf(content);
+    auto needle = ToChars("needle");
+    TextSearcher searcher(needle);
+
+    // Every split of the match by the gap, and the gap right before and after it
+    for (int64_t gap = 1000; gap <= 1006; ++gap) {
+        MoveGapToLogicalIndex(buf, gap);
+        WidenGap(buf, 64);
+        IONL_CHECK(searcher.FindNext(buf, 0, buf.GetContentSize()) == 1000);
+        // A range cutting the match short doesn't find it
+        IONL_CHECK(searcher.FindNext(buf, 0, 1005) == -1);
+        IONL_CHECK(searcher.FindNext(buf, 1001, buf.GetContentSize()) == -1);
+    }
+}
+
+IONL_TEST(text_search, find_all_matches_naive_search) {
+    std::mt19937 rng(6);
+    std::string content;
+    while (content.size() < 50000) {
+        content += "abcab"[rng() % 5];
+    }
+    GapBuffer buf(content);
+    for (auto needleText : { "ab", "abc", "cabba", "aaaaaaaaaaaaaaaaaaaaa", "b" }) {
+        auto needle = ToChars(needleText);
+        TextSearcher searcher(needle);
+        for (int i = 0; i < 5; ++i) {
+            MoveGapToLogicalIndex(buf, rng() % (buf.GetContentSize() + 1));
+            std::vector<TextSearchMatch> matches;
+            searcher.FindAll(buf, 0, buf.GetContentSize(), matches);
+            IONL_CHECK(AreMatchesEqual(matches, FindAllNaively(buf, needle)));
+        }
+    }
+}
+
+IONL_TEST(text_search, case_insensitive) {
+    GapBuffer buf("Hello HELLO hello ΑΒΓ αβγ");
+    MoveGapToLogicalIndex(buf, 8);
+    std::vector<TextSearchMatch> matches;
+    TextSearcher(ToChars("hello"), { .caseInsensitive = true }).FindAll(buf, 0, buf.GetContentSize(), matches);
+    IONL_CHECK(matches.size() == 3);
+
+    matches.clear();
+    std::vector<ImWchar> greek = { 0x3B1, 0x3B2, 0x3B3 };
+    TextSearcher(greek, { .caseInsensitive = true }).FindAll(buf, 0, buf.GetContentSize(), matches);
+    IONL_CHECK(matches.size() == 2);
+}
+
+IONL_TEST(text_search, match_index_follows_edits) {
+    std::mt19937 rng(7);
+    std::string content;
+    while (content.size() < 20000) {
+        content += "find me\nor not\n";
+    }
+    TextBuffer tb(GapBuffer{ content });
+    auto needle = ToChars("me");
+    tb.SetSearch(TextSearcher(needle));
+
+    for (int step = 0; step < 200; ++step) {
+        auto size = tb.gapBuffer.GetContentSize();
+        int64_t idx = rng() % (size + 1);
+        if (rng() % 2 == 0) {
+            auto text = ToChars(rng() % 2 ? "me" : "\nm");
+            tb.Insert(idx, text.data(), text.size());
+        } else {
+            tb.Erase(idx, std::min<int64_t>(rng() % 10, size - idx));
+        }
+        tb.RefreshCaches();
+        IONL_CHECK(AreMatchesEqual(tb.matchIndex.GetMatches(), FindAllNaively(tb.gapBuffer, needle)));
+    }
+}
@@ -0,0 +1,29 @@
+#include "testing.hpp"
+
+#include <ionl/utf8.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Ionl;
+
+IONL_TEST(utf8, count_matches_decoded_size) {
+    std::mt19937 rng(8);
+    // Mostly valid text with runs of ASCII long enough for the vectorized paths, and every kind of malformed sequence in between
+    const std::string kPieces[] = {
+        "plain ascii text that is longer than 32 bytes ", "\r\n", "\r", "\n", "é", "中文", "😀", "\x80", "\xC3", "\xE4\xB8", "\xF0\x9F\x98",
+        "\xC0\xAF", "\xED\xA0\x80", "\xFF", std::string(1, '\0'),
+    };
+    for (int round = 0; round < 200; ++round) {
+        std::string text;
+        for (int n = rng() % 40; n > 0; --n) {
+            text += kPieces[rng() % std::size(kPieces)];
+        }
+        auto begin = text.data();
+        auto end = text.data() + text.size();
+        std::vector<ImWchar> out(text.size());
+        IONL_CHECK(CountUtf8ToImWchar(begin, end) == TranscodeUtf8ToImWchar(begin, end, out.data()));
+        IONL_CHECK(CountUtf8ToImWcharNormalizingNewlines(begin, end) == TranscodeUtf8ToImWcharNormalizingNewlines(begin, end, out.data()));
+    }
+}